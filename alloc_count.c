@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * LD_PRELOAD shim for `make check-alloc`: heap allocations are let through
+ * while status starts up, and the first one after CHECK_ALLOC_WARMUP_MS
+ * (default 3000) is reported with its caller and ends the process with
+ * status 1. Everything past the first frames has to run without malloc().
+ */
+
+#define DEFAULT_WARMUP_MS 3000
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static int64_t warm_at = 0;
+
+static int64_t monotonic_ms(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+__attribute__((constructor)) static void start(void) {
+  const char *warmup = getenv("CHECK_ALLOC_WARMUP_MS");
+
+  warm_at = monotonic_ms() +
+            (warmup != NULL ? atoi(warmup) : DEFAULT_WARMUP_MS);
+}
+
+/* Warm: report and stop; snprintf() of integers does not allocate */
+static void check(const char *function, size_t size, void *caller) {
+  char message[128];
+  int len;
+
+  if (warm_at == 0 || monotonic_ms() < warm_at) {
+    return;
+  }
+
+  len = snprintf(message, sizeof(message),
+                 "check-alloc: %s(%zu) after warm-up, called from %p\n",
+                 function, size, caller);
+  write(STDERR_FILENO, message, len);
+  _exit(1);
+}
+
+void *malloc(size_t size) {
+  check("malloc", size, __builtin_return_address(0));
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  check("calloc", count * size, __builtin_return_address(0));
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  check("realloc", size, __builtin_return_address(0));
+  return __libc_realloc(p, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+  check("posix_memalign", size, __builtin_return_address(0));
+  if ((*p = __libc_memalign(alignment, size)) == NULL) {
+    return ENOMEM;
+  }
+  return 0;
+}
@@ -0,0 +1,35 @@
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+static union {
+  unsigned char bytes[ARENA_SIZE];
+  long double align; // as aligned as anything malloc() returns
+} arena;
+static size_t arena_top = 0;
+
+/* Zeroed memory; running out means ARENA_SIZE is wrong, so that is fatal */
+void *arena_alloc(size_t size) {
+  size_t start = (arena_top + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  void *p;
+
+  if (size > ARENA_SIZE - start) {
+    fprintf(stderr, "arena exhausted (%zu of %d bytes used)!\n", arena_top,
+            ARENA_SIZE);
+    exit(1);
+  }
+
+  p = arena.bytes + start;
+  arena_top = start + size;
+  memset(p, 0, size);
+
+  return p;
+}
+
+size_t arena_used(void) { return arena_top; }
@@ -0,0 +1,17 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_SIZE (512 * 1024)
+
+/*
+ * One fixed block reserved at startup. The buffers and tables of the modules
+ * are carved out of it on their first refresh and live for the whole run, so
+ * the steady state of the collectors never reaches malloc(). libpulse and
+ * libdbus still allocate for each message they build or receive.
+ */
+void *arena_alloc(size_t size);
+size_t arena_used(void);
+
+#endif // ARENA_H
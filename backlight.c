@@ -0,0 +1,133 @@
+#include "backlight.h"
+#include "replay.h"
+#include "sysfs.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The backlight is looked up once and its brightness stays open and is
+ * pread() on every refresh, like the battery attributes; max_brightness
+ * never changes and is read when it is opened. Nothing polls it: writes to
+ * the brightness file and brightness keys the firmware handles both send a
+ * "backlight" uevent, which refreshes the module, and a backlight that comes
+ * or goes has the search run again.
+ */
+
+/* Interface types in the order systemd prefers them */
+static const char *const BacklightTypes[] = {"firmware", "platform", "raw"};
+
+#define BACKLIGHT_TYPES (sizeof(BacklightTypes) / sizeof(BacklightTypes[0]))
+
+struct backlight_candidate {
+  char name[BACKLIGHT_NAME_LEN];
+  size_t rank; // index into BacklightTypes, BACKLIGHT_TYPES for none
+};
+
+static char opened_backlight[BACKLIGHT_NAME_LEN] = "";
+static int brightness_fd = -1;
+static int64_t max_brightness = 0;
+static int64_t brightness = 0;
+static int8_t searched = 0;
+
+static int8_t rank_backlight(const char *name, void *data) {
+  struct backlight_candidate *best = data;
+  char type[SYSFS_VALUE_LEN];
+  size_t rank;
+
+  if (strlen(name) >= BACKLIGHT_NAME_LEN ||
+      !sysfs_read(BACKLIGHT_DIR, name, BACKLIGHT_TYPE_FILE, type,
+                  sizeof(type))) {
+    return 0;
+  }
+
+  for (rank = 0;
+       rank < BACKLIGHT_TYPES && strcmp(type, BacklightTypes[rank]) != 0;
+       rank++)
+    ;
+
+  if (rank < best->rank) {
+    best->rank = rank;
+    strcpy(best->name, name);
+  }
+
+  return rank == 0; // nothing beats firmware
+}
+
+static void close_backlight(void) {
+  if (brightness_fd >= 0) {
+    replay_close(brightness_fd);
+  }
+
+  brightness_fd = -1;
+  opened_backlight[0] = '\0';
+}
+
+static int8_t open_backlight(void) {
+  struct backlight_candidate best = {"", BACKLIGHT_TYPES};
+  int fd;
+
+  sysfs_scan_dir(BACKLIGHT_DIR, rank_backlight, &best);
+  if (best.name[0] == '\0') {
+    return 0;
+  }
+
+  if ((fd = sysfs_open(BACKLIGHT_DIR, best.name, BACKLIGHT_MAX_FILE)) == -1) {
+    return 0;
+  }
+  if (!sysfs_pread_int(fd, &max_brightness) || max_brightness <= 0) {
+    replay_close(fd);
+    return 0;
+  }
+  replay_close(fd);
+
+  brightness_fd = sysfs_open(BACKLIGHT_DIR, best.name,
+                             BACKLIGHT_BRIGHTNESS_FILE);
+  if (brightness_fd == -1) {
+    return 0;
+  }
+  strcpy(opened_backlight, best.name);
+
+  return 1;
+}
+
+/* Close the backlight and look for one again on the next sample */
+void backlight_invalidate(void) {
+  close_backlight();
+  searched = 0;
+}
+
+/* Returns 0 without a backlight, which desktops usually are */
+int8_t backlight_sample(void) {
+  if (brightness_fd == -1) {
+    if (searched) {
+      return 0;
+    }
+    searched = 1;
+
+    if (!open_backlight()) {
+      return 0;
+    }
+  }
+
+  /* A backlight that went away is looked up once more */
+  if (!sysfs_pread_int(brightness_fd, &brightness)) {
+    backlight_invalidate();
+    return 0;
+  }
+
+  return 1;
+}
+
+uint8_t backlight_percent(void) {
+  if (brightness <= 0) {
+    return 0;
+  }
+  if (brightness >= max_brightness) {
+    return 100;
+  }
+
+  return (uint8_t)((brightness * 100 + max_brightness / 2) / max_brightness);
+}
+
+const char *backlight_name(void) { return opened_backlight; }
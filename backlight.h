@@ -0,0 +1,18 @@
+#ifndef BACKLIGHT_H
+#define BACKLIGHT_H
+
+#include <stdint.h>
+
+#define BACKLIGHT_DIR "/sys/class/backlight/"
+#define BACKLIGHT_SUBSYSTEM "backlight"
+#define BACKLIGHT_BRIGHTNESS_FILE "/brightness"
+#define BACKLIGHT_MAX_FILE "/max_brightness"
+#define BACKLIGHT_TYPE_FILE "/type"
+#define BACKLIGHT_NAME_LEN 32
+
+void backlight_invalidate(void);
+int8_t backlight_sample(void);
+uint8_t backlight_percent(void);
+const char *backlight_name(void);
+
+#endif // BACKLIGHT_H
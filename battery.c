@@ -1,93 +1,150 @@
 #include "battery.h"
+#include "replay.h"
+#include "sysfs.h"
 
-#include <dirent.h>
-#include <errno.h>
-#include <limits.h>
-#include <linux/limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-int8_t get_battery_name(char *battery_name) {
-
-  DIR *dirp;
-  struct dirent *dir;
-  int8_t found = 0;
-
-  battery_name[0] = '\0';
-
-  if ((dirp = opendir(POWER_SUPPLY_DIR)) == NULL) {
-    if (errno != ENOENT) {
-      perror("opendir() failed!");
+#include <unistd.h>
+
+/*
+ * The attributes of the battery in use stay open and are pread() on every
+ * query, so a refresh costs one syscall per value and no allocation. They are
+ * dropped as soon as a read fails, which is what an unplugged battery does.
+ */
+
+enum BatteryFile {
+  BF_CAPACITY,
+  BF_STATUS,
+  BF_ENERGY_NOW,
+  BF_ENERGY_FULL,
+  BF_POWER_NOW,
+  BF_CHARGE_NOW,
+  BF_CHARGE_FULL,
+  BF_CURRENT_NOW,
+  BF_COUNT
+};
+
+static const char *battery_files[BF_COUNT] = {
+    [BF_CAPACITY] = BAT_CAPACITY_FILE,
+    [BF_STATUS] = BAT_STATUS_FILE,
+    [BF_ENERGY_NOW] = BAT_ENERGY_NOW_FILE,
+    [BF_ENERGY_FULL] = BAT_ENERGY_FULL_FILE,
+    [BF_POWER_NOW] = BAT_POWER_NOW_FILE,
+    [BF_CHARGE_NOW] = BAT_CHARGE_NOW_FILE,
+    [BF_CHARGE_FULL] = BAT_CHARGE_FULL_FILE,
+    [BF_CURRENT_NOW] = BAT_CURRENT_NOW_FILE,
+};
+
+static char opened_battery[BAT_NAME_LEN] = "";
+static int battery_fds[BF_COUNT];
+
+static void close_battery(void) {
+  int i;
+
+  for (i = 0; i < BF_COUNT; i++) {
+    if (battery_fds[i] >= 0) {
+      replay_close(battery_fds[i]);
     }
-    return 0;
+    battery_fds[i] = -1;
   }
 
-  while ((dir = readdir(dirp)) != NULL) {
-    if (dir->d_name[0] == '.') {
-      continue;
+  opened_battery[0] = '\0';
+}
+
+/* Descriptor of one attribute, -1 when the battery does not have it */
+static int battery_fd(char *battery_name, enum BatteryFile file) {
+  int i;
+
+  if (strncmp(opened_battery, battery_name, BAT_NAME_LEN) != 0) {
+    if (opened_battery[0] != '\0') {
+      close_battery();
     }
 
-    if (!(strncmp(dir->d_name, BAT_NAME_PATTERN, strlen(BAT_NAME_PATTERN)))) {
-      strncpy(battery_name, dir->d_name, strlen(dir->d_name) + 1);
-      found = 1;
-      break;
+    for (i = 0; i < BF_COUNT; i++) {
+      battery_fds[i] = sysfs_open(POWER_SUPPLY_DIR, battery_name,
+                                  battery_files[i]);
     }
+    snprintf(opened_battery, BAT_NAME_LEN, "%s", battery_name);
   }
 
-  if (!found && errno) {
-    perror("readdir() failed!");
-  }
+  return battery_fds[file];
+}
 
-  if ((closedir(dirp)) == -1) {
-    perror("closedir() failed!");
+static int8_t is_battery(const char *name, void *battery_name) {
+  if (strncmp(name, BAT_NAME_PATTERN, strlen(BAT_NAME_PATTERN)) ||
+      strlen(name) >= BAT_NAME_LEN) {
+    return 0;
   }
 
-  return found;
+  snprintf(battery_name, BAT_NAME_LEN, "%s", name);
+  return 1;
 }
 
-int8_t get_battery_capacity(char *battery_name) {
+int8_t get_battery_name(char *battery_name) {
 
-  FILE *fp;
-  char battery_path[PATH_MAX] = POWER_SUPPLY_DIR;
-  int8_t capacity;
+  if (opened_battery[0] != '\0') {
+    snprintf(battery_name, BAT_NAME_LEN, "%s", opened_battery);
+    return 1;
+  }
 
-  strncat(battery_path, battery_name, strlen(battery_name) + 1);
-  strncat(battery_path, BAT_CAPACITY_FILE, strlen(BAT_CAPACITY_FILE) + 1);
+  battery_name[0] = '\0';
 
-  if ((fp = fopen(battery_path, "r")) == NULL) {
-    perror("fopen() error!");
-    exit(1);
-  }
+  return sysfs_scan_dir(POWER_SUPPLY_DIR, is_battery, battery_name);
+}
+
+int8_t get_battery_capacity(char *battery_name) {
 
-  fscanf(fp, "%hhd", &capacity);
+  int64_t capacity = 0;
 
-  if ((fclose(fp)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
+  if (!sysfs_pread_int(battery_fd(battery_name, BF_CAPACITY), &capacity)) {
+    close_battery();
   }
 
-  return capacity;
+  return (int8_t)capacity;
 }
 
 void get_battery_status(char *battery_name, char *battery_status) {
 
-  char battery_path[PATH_MAX] = POWER_SUPPLY_DIR;
-  FILE *fp;
+  if (!sysfs_pread(battery_fd(battery_name, BF_STATUS), battery_status,
+                   BAT_STATUS_LEN)) {
+    battery_status[0] = '\0';
+    close_battery();
+  }
+}
+
+/* Optional attributes: not every battery exposes every file */
+static int8_t read_battery_value(char *battery_name, enum BatteryFile file,
+                                 int64_t *value) {
 
-  strncat(battery_path, battery_name, strlen(battery_name) + 1);
-  strncat(battery_path, BAT_STATUS_FILE, strlen(BAT_STATUS_FILE) + 1);
+  return sysfs_pread_int(battery_fd(battery_name, file), value);
+}
 
-  if ((fp = fopen(battery_path, "r")) == NULL) {
-    perror("fopen() error!");
-    exit(1);
+/*
+ * Minutes until empty (or until full when charging), -1 when the battery does
+ * not report a usable rate.
+ */
+int32_t get_battery_time_remaining(char *battery_name, int8_t charging) {
+
+  int64_t now, full, rate;
+
+  if (!(read_battery_value(battery_name, BF_ENERGY_NOW, &now) &&
+        read_battery_value(battery_name, BF_ENERGY_FULL, &full) &&
+        read_battery_value(battery_name, BF_POWER_NOW, &rate)) &&
+      !(read_battery_value(battery_name, BF_CHARGE_NOW, &now) &&
+        read_battery_value(battery_name, BF_CHARGE_FULL, &full) &&
+        read_battery_value(battery_name, BF_CURRENT_NOW, &rate))) {
+    return -1;
   }
 
-  fscanf(fp, "%s", battery_status);
+  if (rate <= 0) {
+    return -1;
+  }
 
-  if ((fclose(fp)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
+  if (charging) {
+    now = full > now ? full - now : 0;
   }
+
+  return (int32_t)(now * 60 / rate);
 }
@@ -5,11 +5,20 @@
 
 #define POWER_SUPPLY_DIR "/sys/class/power_supply/"
 #define BAT_NAME_PATTERN "BAT"
+#define BAT_NAME_LEN 5
+#define BAT_STATUS_LEN 12
 #define BAT_CAPACITY_FILE "/capacity"
 #define BAT_STATUS_FILE "/status"
+#define BAT_ENERGY_NOW_FILE "/energy_now"
+#define BAT_ENERGY_FULL_FILE "/energy_full"
+#define BAT_POWER_NOW_FILE "/power_now"
+#define BAT_CHARGE_NOW_FILE "/charge_now"
+#define BAT_CHARGE_FULL_FILE "/charge_full"
+#define BAT_CURRENT_NOW_FILE "/current_now"
 
 int8_t get_battery_name(char *battery_name);
 int8_t get_battery_capacity(char *battery_name);
 void get_battery_status(char *battery_name, char *battery_status);
+int32_t get_battery_time_remaining(char *battery_name, int8_t charging);
 
 #endif // BATTERY_H
@@ -0,0 +1,17 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+
+#define BLOCK_TEXT_LEN 256
+#define BLOCK_INSTANCE_LEN 32
+
+/* One rendered segment of the status line */
+struct block {
+  char full_text[BLOCK_TEXT_LEN];
+  char instance[BLOCK_INSTANCE_LEN];
+  const char *color; // NULL leaves the bar's default colour
+  uint8_t urgent;
+};
+
+#endif // BLOCK_H
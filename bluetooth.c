@@ -1,20 +1,43 @@
+#include "arena.h"
 #include "bluetooth.h"
+#include "replay.h"
 
 #include <dbus/dbus.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <unistd.h>
 
-#define BLUETOOTH_DEVICE_NAME_LEN 50
 #define BLUETOOTH_BUS_NAME "org.bluez"
 #define BLUETOOTH_ADAPTER_INTERFACE "org.bluez.Adapter1"
 #define BLUETOOTH_DEVICE_INTERFACE "org.bluez.Device1"
 #define BLUETOOTH_BATTERY_INTERFACE "org.bluez.Battery1"
-#define DBUS_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
 #define DBUS_OBJECTMANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
 
+/*
+ * One GetManagedObjects call lists every adapter and device with all of
+ * their properties, so a refresh is a single D-Bus round trip whatever the
+ * number of adapters and devices. Objects are kept in an open addressing
+ * table keyed by object path, which finds the entry to update in O(1) and
+ * remembers the order objects first showed up in, so devices keep their
+ * place in the bar. Objects bluez no longer lists are left behind with an
+ * old `seen`; once half of the slots are taken the table starts over.
+ */
+
+static struct bluetooth_object *objects;
+static uint16_t *order; // slots in the order their objects were first listed
+static uint16_t object_count = 0;
+static uint32_t generation = 0;
+static int8_t powered = 0;
+
+/* freedesktop icon names bluez gives devices, and what to call them */
+static const char *const DeviceClasses[][2] = {
+    {"audio-headset", "headset"},   {"audio-headphones", "headphones"},
+    {"audio-card", "speaker"},      {"input-mouse", "mouse"},
+    {"input-keyboard", "keyboard"}, {"input-gaming", "gamepad"},
+    {"input-tablet", "tablet"},     {"phone", "phone"},
+    {"computer", "computer"},
+};
+
 /* Helper function to check D-Bus error */
 static int dbus_check_error(DBusError *error) {
   if (dbus_error_is_set(error)) {
@@ -24,605 +47,281 @@ static int dbus_check_error(DBusError *error) {
   return 1;
 }
 
-/* Get property value from D-Bus object */
-static DBusMessage *get_property(DBusConnection *conn, const char *path,
-                                 const char *interface, const char *property) {
-  DBusError error;
-  DBusMessage *msg, *reply;
-
-  dbus_error_init(&error);
+/* -----TABLE----- */
 
-  msg = dbus_message_new_method_call(BLUETOOTH_BUS_NAME, path,
-                                     DBUS_PROPERTIES_INTERFACE, "Get");
+static uint32_t hash_path(const char *path) {
+  uint32_t hash = 2166136261u;
 
-  if (!msg) {
-    return NULL;
+  while (*path) {
+    hash = (hash ^ (unsigned char)*path++) * 16777619u;
   }
 
-  dbus_message_append_args(msg, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING,
-                           &property, DBUS_TYPE_INVALID);
-
-  reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &error);
-  dbus_message_unref(msg);
-
-  if (!dbus_check_error(&error)) {
-    if (reply)
-      dbus_message_unref(reply);
-    return NULL;
-  }
-
-  return reply;
+  return hash;
 }
 
-/* Find adapter paths - try common paths first, then enumerate */
-static int find_adapter_path(DBusConnection *conn, char *adapter_path,
-                             size_t path_len) {
-  DBusError error;
-  DBusMessage *msg, *reply;
-  DBusMessageIter iter, array_iter, entry_iter, dict_iter, entry_iter2;
-  const char *object_path;
-  const char *interface_name;
-
-  /* First try common adapter paths */
-  const char *common_paths[] = {"/org/bluez/hci1", "/org/bluez/hci0"};
-  int i;
-
-  for (i = 0; i < 2; i++) {
-    DBusMessage *test_reply = get_property(
-        conn, common_paths[i], BLUETOOTH_ADAPTER_INTERFACE, "Powered");
-    if (test_reply) {
-      dbus_message_unref(test_reply);
-      strncpy(adapter_path, common_paths[i], path_len - 1);
-      adapter_path[path_len - 1] = '\0';
-      return 1;
-    }
-  }
-
-  /* If common paths don't work, enumerate via GetManagedObjects */
-  dbus_error_init(&error);
-
-  msg = dbus_message_new_method_call(BLUETOOTH_BUS_NAME, "/",
-                                     DBUS_OBJECTMANAGER_INTERFACE,
-                                     "GetManagedObjects");
-
-  if (!msg) {
-    return 0;
-  }
-
-  reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &error);
-  dbus_message_unref(msg);
-
-  if (!dbus_check_error(&error) || !reply) {
-    if (reply)
-      dbus_message_unref(reply);
-    return 0;
+static void clear_objects(void) {
+  if (objects == NULL) {
+    objects = arena_alloc(BLUETOOTH_MAX_OBJECTS * sizeof(*objects));
+    order = arena_alloc(BLUETOOTH_MAX_OBJECTS / 2 * sizeof(*order));
   }
 
-  if (!dbus_message_iter_init(reply, &iter)) {
-    dbus_message_unref(reply);
-    return 0;
-  }
-
-  if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
-    dbus_message_unref(reply);
-    return 0;
-  }
-
-  dbus_message_iter_recurse(&iter, &array_iter);
-
-  int found_count = 0;
-  char last_adapter[256] = "";
-
-  while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_DICT_ENTRY) {
-    dbus_message_iter_recurse(&array_iter, &entry_iter);
-
-    /* Get object path */
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_OBJECT_PATH) {
-      dbus_message_iter_next(&array_iter);
-      continue;
-    }
-
-    dbus_message_iter_get_basic(&entry_iter, &object_path);
-    dbus_message_iter_next(&entry_iter);
-
-    /* Check interfaces dictionary */
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_ARRAY) {
-      dbus_message_iter_next(&array_iter);
-      continue;
-    }
-
-    dbus_message_iter_recurse(&entry_iter, &dict_iter);
-
-    while (dbus_message_iter_get_arg_type(&dict_iter) == DBUS_TYPE_DICT_ENTRY) {
-      dbus_message_iter_recurse(&dict_iter, &entry_iter2);
-
-      if (dbus_message_iter_get_arg_type(&entry_iter2) != DBUS_TYPE_STRING) {
-        dbus_message_iter_next(&dict_iter);
-        continue;
-      }
-
-      dbus_message_iter_get_basic(&entry_iter2, &interface_name);
-
-      if (strcmp(interface_name, BLUETOOTH_ADAPTER_INTERFACE) == 0) {
-        found_count++;
-        strncpy(last_adapter, object_path, sizeof(last_adapter) - 1);
-        last_adapter[sizeof(last_adapter) - 1] = '\0';
-      }
-
-      dbus_message_iter_next(&dict_iter);
-    }
-
-    dbus_message_iter_next(&array_iter);
-  }
-
-  dbus_message_unref(reply);
-
-  if (found_count > 0) {
-    /* Use the last adapter found (skip first one used for volume) */
-    strncpy(adapter_path, last_adapter, path_len - 1);
-    adapter_path[path_len - 1] = '\0';
-    return 1;
-  }
-
-  return 0;
+  memset(objects, 0, BLUETOOTH_MAX_OBJECTS * sizeof(*objects));
+  object_count = 0;
 }
 
-/* Check if bluetooth adapter is powered (enabled) */
-short bluetooth_is_blocked(void) {
-  DBusConnection *conn;
-  DBusError error;
-  char adapter_path[256];
-  DBusMessage *reply;
-  DBusMessageIter iter, variant_iter;
-  dbus_bool_t powered = 0;
+/*
+ * The entry for `path`, added when new and reset when this refresh sees it
+ * for the first time. NULL for paths that do not fit and once the table is
+ * half full; the objects past that are left out.
+ */
+static struct bluetooth_object *find_object(const char *path) {
+  uint32_t i = hash_path(path) & (BLUETOOTH_MAX_OBJECTS - 1);
+  struct bluetooth_object *object;
 
-  dbus_error_init(&error);
-  conn = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
-
-  if (!dbus_check_error(&error) || !conn) {
-    return 1; /* Assume blocked on error */
+  while (objects[i].path[0] != '\0' && strcmp(objects[i].path, path) != 0) {
+    i = (i + 1) & (BLUETOOTH_MAX_OBJECTS - 1);
   }
+  object = &objects[i];
 
-  if (!find_adapter_path(conn, adapter_path, sizeof(adapter_path))) {
-    dbus_connection_unref(conn);
-    return 1; /* No adapter found, assume blocked */
-  }
-
-  reply =
-      get_property(conn, adapter_path, BLUETOOTH_ADAPTER_INTERFACE, "Powered");
-  if (!reply) {
-    dbus_connection_unref(conn);
-    return 1;
-  }
-
-  if (dbus_message_iter_init(reply, &iter)) {
-    if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_VARIANT) {
-      dbus_message_iter_recurse(&iter, &variant_iter);
-      if (dbus_message_iter_get_arg_type(&variant_iter) == DBUS_TYPE_BOOLEAN) {
-        dbus_message_iter_get_basic(&variant_iter, &powered);
-      }
+  if (object->path[0] == '\0') {
+    if (object_count >= BLUETOOTH_MAX_OBJECTS / 2 ||
+        strlen(path) >= sizeof(object->path)) {
+      return NULL;
     }
+    strcpy(object->path, path);
+    order[object_count++] = i;
   }
 
-  dbus_message_unref(reply);
-  dbus_connection_unref(conn);
+  if (object->seen != generation) {
+    object->seen = generation;
+    object->name[0] = '\0';
+    object->icon[0] = '\0';
+    object->kind = 0;
+    object->powered = 0;
+    object->connected = 0;
+    object->battery = -1;
+  }
 
-  /* Return 1 if blocked (not powered), 0 if unblocked (powered) */
-  return powered ? 0 : 1;
+  return object;
 }
 
-/* Check if any bluetooth device is connected */
-short bluetooth_is_connected(void) {
-  DBusConnection *conn;
-  DBusError error;
-  DBusMessage *msg, *reply;
-  DBusMessageIter iter, array_iter, entry_iter, dict_iter, entry_iter2;
-  const char *object_path;
-  const char *interface_name;
-  dbus_bool_t connected = 0;
-
-  dbus_error_init(&error);
-  conn = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+/* -----PARSING----- */
 
-  if (!dbus_check_error(&error) || !conn) {
-    return 0;
-  }
-
-  msg = dbus_message_new_method_call(BLUETOOTH_BUS_NAME, "/",
-                                     DBUS_OBJECTMANAGER_INTERFACE,
-                                     "GetManagedObjects");
+/* The value inside a variant, if it has the type asked for */
+static int8_t variant_value(DBusMessageIter *variant, int type, void *value) {
+  DBusMessageIter inner;
 
-  if (!msg) {
-    dbus_connection_unref(conn);
+  dbus_message_iter_recurse(variant, &inner);
+  if (dbus_message_iter_get_arg_type(&inner) != type) {
     return 0;
   }
 
-  reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &error);
-  dbus_message_unref(msg);
+  dbus_message_iter_get_basic(&inner, value);
+  return 1;
+}
 
-  if (!dbus_check_error(&error) || !reply) {
-    if (reply)
-      dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return 0;
-  }
+static void copy_string(char *dst, size_t size, DBusMessageIter *variant) {
+  const char *value;
 
-  if (!dbus_message_iter_init(reply, &iter)) {
-    dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return 0;
-  }
-
-  if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
-    dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return 0;
+  if (variant_value(variant, DBUS_TYPE_STRING, &value)) {
+    strncpy(dst, value, size - 1);
+    dst[size - 1] = '\0';
   }
+}
 
-  dbus_message_iter_recurse(&iter, &array_iter);
+/* Take what the bar shows from the a{sv} properties of one interface */
+static void read_properties(DBusMessageIter *properties, const char *interface,
+                            struct bluetooth_object *object) {
+  DBusMessageIter entry;
+  dbus_bool_t flag;
+  unsigned char percentage;
+  const char *key;
 
-  while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_DICT_ENTRY) {
-    dbus_message_iter_recurse(&array_iter, &entry_iter);
+  for (; dbus_message_iter_get_arg_type(properties) == DBUS_TYPE_DICT_ENTRY;
+       dbus_message_iter_next(properties)) {
+    dbus_message_iter_recurse(properties, &entry);
 
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_OBJECT_PATH) {
-      dbus_message_iter_next(&array_iter);
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING) {
       continue;
     }
+    dbus_message_iter_get_basic(&entry, &key);
+    dbus_message_iter_next(&entry);
 
-    dbus_message_iter_get_basic(&entry_iter, &object_path);
-    dbus_message_iter_next(&entry_iter);
-
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_ARRAY) {
-      dbus_message_iter_next(&array_iter);
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_VARIANT) {
       continue;
     }
 
-    dbus_message_iter_recurse(&entry_iter, &dict_iter);
-
-    while (dbus_message_iter_get_arg_type(&dict_iter) == DBUS_TYPE_DICT_ENTRY) {
-      dbus_message_iter_recurse(&dict_iter, &entry_iter2);
-
-      if (dbus_message_iter_get_arg_type(&entry_iter2) != DBUS_TYPE_STRING) {
-        dbus_message_iter_next(&dict_iter);
-        continue;
+    if (strcmp(interface, BLUETOOTH_ADAPTER_INTERFACE) == 0) {
+      if (strcmp(key, "Powered") == 0 &&
+          variant_value(&entry, DBUS_TYPE_BOOLEAN, &flag)) {
+        object->powered = flag != 0;
       }
-
-      dbus_message_iter_get_basic(&entry_iter2, &interface_name);
-
-      if (strcmp(interface_name, BLUETOOTH_DEVICE_INTERFACE) == 0) {
-        DBusMessage *prop_reply = get_property(
-            conn, object_path, BLUETOOTH_DEVICE_INTERFACE, "Connected");
-        if (prop_reply) {
-          DBusMessageIter prop_iter, prop_variant;
-          if (dbus_message_iter_init(prop_reply, &prop_iter)) {
-            if (dbus_message_iter_get_arg_type(&prop_iter) ==
-                DBUS_TYPE_VARIANT) {
-              dbus_message_iter_recurse(&prop_iter, &prop_variant);
-              if (dbus_message_iter_get_arg_type(&prop_variant) ==
-                  DBUS_TYPE_BOOLEAN) {
-                dbus_message_iter_get_basic(&prop_variant, &connected);
-                if (connected) {
-                  dbus_message_unref(prop_reply);
-                  dbus_message_unref(reply);
-                  dbus_connection_unref(conn);
-                  return 1;
-                }
-              }
-            }
-          }
-          dbus_message_unref(prop_reply);
-        }
+    } else if (strcmp(interface, BLUETOOTH_DEVICE_INTERFACE) == 0) {
+      if (strcmp(key, "Connected") == 0 &&
+          variant_value(&entry, DBUS_TYPE_BOOLEAN, &flag)) {
+        object->connected = flag != 0;
+      } else if (strcmp(key, "Alias") == 0) {
+        copy_string(object->name, sizeof(object->name), &entry);
+      } else if (strcmp(key, "Icon") == 0) {
+        copy_string(object->icon, sizeof(object->icon), &entry);
       }
-
-      dbus_message_iter_next(&dict_iter);
+    } else if (strcmp(key, "Percentage") == 0 &&
+               variant_value(&entry, DBUS_TYPE_BYTE, &percentage)) {
+      object->battery = percentage;
     }
-
-    dbus_message_iter_next(&array_iter);
   }
-
-  dbus_message_unref(reply);
-  dbus_connection_unref(conn);
-
-  return 0;
 }
 
-/* Get name of connected bluetooth device */
-void get_connected_bluetooth_device_name(char *device_name) {
-  DBusConnection *conn;
-  DBusError error;
-  DBusMessage *msg, *reply;
-  DBusMessageIter iter, array_iter, entry_iter, dict_iter, entry_iter2;
-  const char *object_path;
-  const char *interface_name;
-
-  device_name[0] = '\0';
+/* One object of the reply: an object path and its a{sa{sv}} interfaces */
+static void read_object(DBusMessageIter *object_entry) {
+  DBusMessageIter interfaces, entry, properties;
+  struct bluetooth_object *object = NULL;
+  const char *path, *interface;
 
-  dbus_error_init(&error);
-  conn = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
-
-  if (!dbus_check_error(&error) || !conn) {
+  if (dbus_message_iter_get_arg_type(object_entry) != DBUS_TYPE_OBJECT_PATH) {
     return;
   }
+  dbus_message_iter_get_basic(object_entry, &path);
+  dbus_message_iter_next(object_entry);
 
-  msg = dbus_message_new_method_call(BLUETOOTH_BUS_NAME, "/",
-                                     DBUS_OBJECTMANAGER_INTERFACE,
-                                     "GetManagedObjects");
-
-  if (!msg) {
-    dbus_connection_unref(conn);
+  if (dbus_message_iter_get_arg_type(object_entry) != DBUS_TYPE_ARRAY) {
     return;
   }
 
-  reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &error);
-  dbus_message_unref(msg);
+  for (dbus_message_iter_recurse(object_entry, &interfaces);
+       dbus_message_iter_get_arg_type(&interfaces) == DBUS_TYPE_DICT_ENTRY;
+       dbus_message_iter_next(&interfaces)) {
+    dbus_message_iter_recurse(&interfaces, &entry);
 
-  if (!dbus_check_error(&error) || !reply) {
-    if (reply)
-      dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return;
-  }
-
-  if (!dbus_message_iter_init(reply, &iter)) {
-    dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return;
-  }
-
-  if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
-    dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return;
-  }
-
-  dbus_message_iter_recurse(&iter, &array_iter);
-
-  while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_DICT_ENTRY) {
-    dbus_message_iter_recurse(&array_iter, &entry_iter);
-
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_OBJECT_PATH) {
-      dbus_message_iter_next(&array_iter);
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING) {
       continue;
     }
+    dbus_message_iter_get_basic(&entry, &interface);
+    dbus_message_iter_next(&entry);
 
-    dbus_message_iter_get_basic(&entry_iter, &object_path);
-    dbus_message_iter_next(&entry_iter);
-
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_ARRAY) {
-      dbus_message_iter_next(&array_iter);
+    if ((strcmp(interface, BLUETOOTH_ADAPTER_INTERFACE) != 0 &&
+         strcmp(interface, BLUETOOTH_DEVICE_INTERFACE) != 0 &&
+         strcmp(interface, BLUETOOTH_BATTERY_INTERFACE) != 0) ||
+        dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_ARRAY) {
       continue;
     }
 
-    dbus_message_iter_recurse(&entry_iter, &dict_iter);
-
-    while (dbus_message_iter_get_arg_type(&dict_iter) == DBUS_TYPE_DICT_ENTRY) {
-      dbus_message_iter_recurse(&dict_iter, &entry_iter2);
-
-      if (dbus_message_iter_get_arg_type(&entry_iter2) != DBUS_TYPE_STRING) {
-        dbus_message_iter_next(&dict_iter);
-        continue;
-      }
-
-      dbus_message_iter_get_basic(&entry_iter2, &interface_name);
-
-      if (strcmp(interface_name, BLUETOOTH_DEVICE_INTERFACE) == 0) {
-        DBusMessage *connected_reply = get_property(
-            conn, object_path, BLUETOOTH_DEVICE_INTERFACE, "Connected");
-        dbus_bool_t connected = 0;
-
-        if (connected_reply) {
-          DBusMessageIter connected_iter, connected_variant;
-          if (dbus_message_iter_init(connected_reply, &connected_iter)) {
-            if (dbus_message_iter_get_arg_type(&connected_iter) ==
-                DBUS_TYPE_VARIANT) {
-              dbus_message_iter_recurse(&connected_iter, &connected_variant);
-              if (dbus_message_iter_get_arg_type(&connected_variant) ==
-                  DBUS_TYPE_BOOLEAN) {
-                dbus_message_iter_get_basic(&connected_variant, &connected);
-              }
-            }
-          }
-          dbus_message_unref(connected_reply);
-        }
-
-        if (connected) {
-          DBusMessage *name_reply = get_property(
-              conn, object_path, BLUETOOTH_DEVICE_INTERFACE, "Name");
-          if (name_reply) {
-            DBusMessageIter name_iter, name_variant;
-            const char *name_value = NULL;
-
-            if (dbus_message_iter_init(name_reply, &name_iter)) {
-              if (dbus_message_iter_get_arg_type(&name_iter) ==
-                  DBUS_TYPE_VARIANT) {
-                dbus_message_iter_recurse(&name_iter, &name_variant);
-                if (dbus_message_iter_get_arg_type(&name_variant) ==
-                    DBUS_TYPE_STRING) {
-                  dbus_message_iter_get_basic(&name_variant, &name_value);
-                  if (name_value) {
-                    strncpy(device_name, name_value,
-                            BLUETOOTH_DEVICE_NAME_LEN - 1);
-                    device_name[BLUETOOTH_DEVICE_NAME_LEN - 1] = '\0';
-                    dbus_message_unref(name_reply);
-                    dbus_message_unref(reply);
-                    dbus_connection_unref(conn);
-                    return;
-                  }
-                }
-              }
-            }
-            dbus_message_unref(name_reply);
-          }
-        }
-      }
+    if (object == NULL && (object = find_object(path)) == NULL) {
+      return;
+    }
 
-      dbus_message_iter_next(&dict_iter);
+    if (strcmp(interface, BLUETOOTH_ADAPTER_INTERFACE) == 0) {
+      object->kind |= BLUETOOTH_ADAPTER;
+    } else if (strcmp(interface, BLUETOOTH_DEVICE_INTERFACE) == 0) {
+      object->kind |= BLUETOOTH_DEVICE;
     }
 
-    dbus_message_iter_next(&array_iter);
+    dbus_message_iter_recurse(&entry, &properties);
+    read_properties(&properties, interface, object);
   }
 
-  dbus_message_unref(reply);
-  dbus_connection_unref(conn);
-}
-
-/* Legacy functions kept for compatibility but not used */
-void find_bluetooth_rfkill_device(char *rfkill_device) {
-  rfkill_device[0] = '\0';
+  if (object != NULL && (object->kind & BLUETOOTH_ADAPTER) &&
+      object->powered) {
+    powered = 1;
+  }
 }
 
-short bluetooth_is_enabled(char *rfkill_device) {
-  (void)rfkill_device; /* Unused */
-  return !bluetooth_is_blocked();
-}
+/* -----RESULTS----- */
 
-/* Get battery percentage string for connected device */
-char *get_connected_bluetooth_device_battery(void) {
-  static char battery_str[32];
+/*
+ * Ask bluez for every adapter and device. Returns 0 when it cannot be
+ * reached, which the bar shows as Bluetooth being off.
+ */
+int8_t bluetooth_refresh(void) {
   DBusConnection *conn;
   DBusError error;
   DBusMessage *msg, *reply;
-  DBusMessageIter iter, array_iter, entry_iter, dict_iter, entry_iter2;
-  const char *object_path;
-  const char *interface_name;
-  const char *connected_device_path = NULL;
-  dbus_bool_t connected = 0;
+  DBusMessageIter iter, objects_iter, entry;
 
-  battery_str[0] = '\0';
+  powered = 0;
+  generation++;
 
   dbus_error_init(&error);
-  conn = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+  conn = replay_dbus_bus(&error);
 
   if (!dbus_check_error(&error) || !conn) {
-    return battery_str;
+    return 0;
   }
 
-  /* Find the connected device path */
   msg = dbus_message_new_method_call(BLUETOOTH_BUS_NAME, "/",
                                      DBUS_OBJECTMANAGER_INTERFACE,
                                      "GetManagedObjects");
 
   if (!msg) {
-    dbus_connection_unref(conn);
-    return battery_str;
+    replay_dbus_unref(conn);
+    return 0;
   }
 
-  dbus_message_append_args(msg, DBUS_TYPE_INVALID);
-
-  reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &error);
+  reply = replay_dbus_call(conn, msg, &error);
   dbus_message_unref(msg);
 
   if (!dbus_check_error(&error) || !reply) {
     if (reply)
       dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return battery_str;
+    replay_dbus_unref(conn);
+    return 0;
   }
 
-  if (!dbus_message_iter_init(reply, &iter)) {
+  if (!dbus_message_iter_init(reply, &iter) ||
+      dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
     dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return battery_str;
+    replay_dbus_unref(conn);
+    return 0;
   }
 
-  if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
-    dbus_message_unref(reply);
-    dbus_connection_unref(conn);
-    return battery_str;
+  if (objects == NULL || object_count >= BLUETOOTH_MAX_OBJECTS / 2) {
+    clear_objects();
   }
 
-  dbus_message_iter_recurse(&iter, &array_iter);
-
-  /* Step 1: Find connected device path */
-  while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_DICT_ENTRY) {
-    dbus_message_iter_recurse(&array_iter, &entry_iter);
-
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_OBJECT_PATH) {
-      dbus_message_iter_next(&array_iter);
-      continue;
-    }
-
-    dbus_message_iter_get_basic(&entry_iter, &object_path);
-    dbus_message_iter_next(&entry_iter);
+  for (dbus_message_iter_recurse(&iter, &objects_iter);
+       dbus_message_iter_get_arg_type(&objects_iter) == DBUS_TYPE_DICT_ENTRY;
+       dbus_message_iter_next(&objects_iter)) {
+    dbus_message_iter_recurse(&objects_iter, &entry);
+    read_object(&entry);
+  }
 
-    if (dbus_message_iter_get_arg_type(&entry_iter) != DBUS_TYPE_ARRAY) {
-      dbus_message_iter_next(&array_iter);
-      continue;
-    }
+  dbus_message_unref(reply);
+  replay_dbus_unref(conn);
 
-    dbus_message_iter_recurse(&entry_iter, &dict_iter);
+  return 1;
+}
 
-    while (dbus_message_iter_get_arg_type(&dict_iter) == DBUS_TYPE_DICT_ENTRY) {
-      dbus_message_iter_recurse(&dict_iter, &entry_iter2);
+/* Whether any adapter is powered */
+int8_t bluetooth_is_powered(void) { return powered; }
 
-      if (dbus_message_iter_get_arg_type(&entry_iter2) != DBUS_TYPE_STRING) {
-        dbus_message_iter_next(&dict_iter);
-        continue;
-      }
+/*
+ * The next connected device after `*cursor`, in the order devices first
+ * showed up; start with a cursor of 0. NULL after the last one.
+ */
+const struct bluetooth_object *bluetooth_next_connected(uint16_t *cursor) {
+  const struct bluetooth_object *object;
 
-      dbus_message_iter_get_basic(&entry_iter2, &interface_name);
-
-      if (strcmp(interface_name, BLUETOOTH_DEVICE_INTERFACE) == 0) {
-        DBusMessage *prop_reply = get_property(
-            conn, object_path, BLUETOOTH_DEVICE_INTERFACE, "Connected");
-        if (prop_reply) {
-          DBusMessageIter prop_iter, prop_variant;
-          if (dbus_message_iter_init(prop_reply, &prop_iter)) {
-            if (dbus_message_iter_get_arg_type(&prop_iter) ==
-                DBUS_TYPE_VARIANT) {
-              dbus_message_iter_recurse(&prop_iter, &prop_variant);
-              if (dbus_message_iter_get_arg_type(&prop_variant) ==
-                  DBUS_TYPE_BOOLEAN) {
-                dbus_message_iter_get_basic(&prop_variant, &connected);
-                if (connected && !connected_device_path) {
-                  size_t path_len = strlen(object_path) + 1;
-                  connected_device_path = (char *)malloc(path_len);
-                  if (connected_device_path) {
-                    memcpy((void *)connected_device_path,
-                           (const void *)object_path, path_len);
-                  }
-                }
-              }
-            }
-          }
-          dbus_message_unref(prop_reply);
-        }
-      }
+  while (*cursor < object_count) {
+    object = &objects[order[(*cursor)++]];
 
-      dbus_message_iter_next(&dict_iter);
+    if (object->seen == generation && (object->kind & BLUETOOTH_DEVICE) &&
+        object->connected) {
+      return object;
     }
-
-    dbus_message_iter_next(&array_iter);
   }
 
-  dbus_message_unref(reply);
+  return NULL;
+}
 
-  /* If no connected device found, return empty string */
-  if (!connected_device_path) {
-    dbus_connection_unref(conn);
-    return battery_str;
-  }
+/* A short name for the kind of device, e.g. "headset", or its alias */
+const char *bluetooth_class(const struct bluetooth_object *device) {
+  size_t i;
 
-  /* Step 2: Get battery percentage from connected device */
-  DBusMessage *perc_reply = get_property(
-      conn, connected_device_path, BLUETOOTH_BATTERY_INTERFACE, "Percentage");
-  if (perc_reply) {
-    DBusMessageIter perc_iter, perc_variant;
-    unsigned char percentage = 0;
-    if (dbus_message_iter_init(perc_reply, &perc_iter)) {
-      if (dbus_message_iter_get_arg_type(&perc_iter) == DBUS_TYPE_VARIANT) {
-        dbus_message_iter_recurse(&perc_iter, &perc_variant);
-        if (dbus_message_iter_get_arg_type(&perc_variant) == DBUS_TYPE_BYTE) {
-          dbus_message_iter_get_basic(&perc_variant, &percentage);
-          snprintf(battery_str, sizeof(battery_str), "%d%%", percentage);
-        }
-      }
+  for (i = 0; i < sizeof(DeviceClasses) / sizeof(DeviceClasses[0]); i++) {
+    if (strcmp(device->icon, DeviceClasses[i][0]) == 0) {
+      return DeviceClasses[i][1];
     }
-    dbus_message_unref(perc_reply);
   }
 
-  dbus_connection_unref(conn);
-  free((void *)connected_device_path);
-
-  return battery_str;
+  return device->name[0] != '\0' ? device->name : "device";
 }
@@ -1,11 +1,31 @@
 #ifndef BLUETOOTH_H
 #define BLUETOOTH_H
 
-void find_bluetooth_rfkill_device(char *rfkill_device);
-short bluetooth_is_enabled(char *rfkill_device);
-short bluetooth_is_blocked(void);
-short bluetooth_is_connected(void);
-void get_connected_bluetooth_device_name(char *device_name);
-char* get_connected_bluetooth_device_battery(void);
+#include <stdint.h>
+
+#define BLUETOOTH_MAX_OBJECTS 256 // a power of two, at most half of it used
+#define BLUETOOTH_PATH_LEN 64
+#define BLUETOOTH_NAME_LEN 48
+#define BLUETOOTH_ICON_LEN 32
+
+#define BLUETOOTH_ADAPTER 1
+#define BLUETOOTH_DEVICE 2
+
+/* An adapter or device as bluez lists it, found by its object path */
+struct bluetooth_object {
+  char path[BLUETOOTH_PATH_LEN];
+  char name[BLUETOOTH_NAME_LEN]; // alias of a device
+  char icon[BLUETOOTH_ICON_LEN]; // e.g. "audio-headset"
+  uint32_t seen;                 // the refresh that listed it last
+  uint8_t kind;                  // BLUETOOTH_ADAPTER and/or BLUETOOTH_DEVICE
+  uint8_t powered;
+  uint8_t connected;
+  int8_t battery; // percent, -1 without a battery
+};
+
+int8_t bluetooth_refresh(void);
+int8_t bluetooth_is_powered(void);
+const struct bluetooth_object *bluetooth_next_connected(uint16_t *cursor);
+const char *bluetooth_class(const struct bluetooth_object *device);
 
 #endif // BLUETOOTH_H
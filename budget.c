@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "budget.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * System call budgets for --budget, one `name = calls` line per module and
+ * one for a whole frame:
+ *
+ *   # comments and blank lines are ignored
+ *   battery = 8 # status, capacity and the time inputs
+ *   frame = 40
+ *
+ * A name without a line may make no calls at all. The first check of a name
+ * is not held to its budget: that is where files are opened and devices are
+ * looked up.
+ */
+
+static const char *const *budget_names;
+static size_t budget_count = 0; // 0 until a file is loaded
+static uint32_t budgets[BUDGET_MAX_NAMES];
+static uint32_t checks[BUDGET_MAX_NAMES];
+
+static int8_t parse_line(const char *path, const char *text, int line) {
+  char name[BUDGET_NAME_LEN], extra;
+  unsigned calls;
+  size_t i;
+
+  if (sscanf(text, " %31[^= \t] = %u %c", name, &calls, &extra) != 2) {
+    fprintf(stderr, "%s:%d: expected name = calls\n", path, line);
+    return 0;
+  }
+
+  for (i = 0; i < budget_count; i++) {
+    if (strcmp(budget_names[i], name) == 0) {
+      budgets[i] = calls;
+      return 1;
+    }
+  }
+
+  fprintf(stderr, "%s:%d: unknown name %s\n", path, line, name);
+  return 0;
+}
+
+static int8_t parse_file(const char *path) {
+  char buffer[BUDGET_BUFFER_LEN];
+  char *text, *newline;
+  ssize_t count;
+  int fd, line = 0;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  count = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+
+  if (count == -1) {
+    perror("read() failed!");
+    return 0;
+  }
+  if (count == sizeof(buffer) - 1) {
+    fprintf(stderr, "%s: larger than %d bytes\n", path,
+            BUDGET_BUFFER_LEN - 1);
+    return 0;
+  }
+  buffer[count] = '\0';
+
+  for (text = buffer; text != NULL; text = newline) {
+    if ((newline = strchr(text, '\n')) != NULL) {
+      *newline++ = '\0';
+    }
+    line++;
+
+    text[strcspn(text, "#")] = '\0'; // a comment runs to the end of the line
+    text += strspn(text, " \t\r");
+    if (text[0] == '\0') {
+      continue;
+    }
+
+    if (!parse_line(path, text, line)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * Read the budgets of `count` names from `path`. Returns 0 with a message on
+ * stderr when the file cannot be read or is invalid.
+ */
+int8_t budget_load(const char *path, const char *const *names, size_t count) {
+  if (count > BUDGET_MAX_NAMES) {
+    fprintf(stderr, "more than %d budgets\n", BUDGET_MAX_NAMES);
+    return 0;
+  }
+
+  budget_names = names;
+  budget_count = count;
+
+  return parse_file(path);
+}
+
+/* Whether `calls` fit the budget of name `index`, reporting when they do not */
+int8_t budget_check(size_t index, uint32_t calls) {
+  if (index >= budget_count || checks[index]++ == 0 ||
+      calls <= budgets[index]) {
+    return 1;
+  }
+
+  fprintf(stderr, "%s: %u system calls, budget %u\n", budget_names[index],
+          calls, budgets[index]);
+  return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUDGET_BUFFER_LEN 4096
+#define BUDGET_NAME_LEN 32
+#define BUDGET_MAX_NAMES 32
+#define BUDGET_FRAME "frame" // the budget of everything one frame takes
+
+int8_t budget_load(const char *path, const char *const *names, size_t count);
+int8_t budget_check(size_t index, uint32_t calls);
+
+#endif // BUDGET_H
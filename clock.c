@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "clock.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct tm cached_tm;
+static time_t cached_time = 0;
+static time_t valid_until = 0; // next time localtime_r() has to run
+static int cached_day = -1;
+static int period = 1;
+static int8_t zone_watched = 0;
+static int8_t zone_changed = 1; // tzset() before the next localtime_r()
+
+/*
+ * Fire on every wall clock multiple of `period` seconds. The timer is
+ * absolute, so it never drifts, and TFD_TIMER_CANCEL_ON_SET makes the next
+ * read fail with ECANCELED when the clock is set or jumps across a suspend.
+ */
+static void arm(int fd) {
+  struct itimerspec spec = {.it_interval = {.tv_sec = period, .tv_nsec = 0}};
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  spec.it_value.tv_sec = now.tv_sec - now.tv_sec % period + period;
+  spec.it_value.tv_nsec = 0;
+
+  if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec,
+                      NULL) == -1) {
+    perror("timerfd_settime() failed!");
+    exit(1);
+  }
+}
+
+int clock_open(int seconds) {
+  int fd;
+
+  period = seconds;
+
+  if ((fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) ==
+      -1) {
+    perror("timerfd_create() failed!");
+    exit(1);
+  }
+
+  arm(fd);
+
+  return fd;
+}
+
+void clock_set_period(int fd, int seconds) {
+  if (seconds != period) {
+    period = seconds;
+    arm(fd);
+  }
+}
+
+/* Consume the pending expirations, returns 1 if a period boundary passed */
+int8_t clock_read(int fd) {
+  uint64_t expirations;
+
+  if (read(fd, &expirations, sizeof(expirations)) == -1) {
+    if (errno == ECANCELED) {
+      valid_until = 0;
+      arm(fd);
+      return 1;
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * inotify descriptor for the directory of /etc/localtime, -1 when it cannot
+ * be watched. timedatectl and friends replace the link by renaming a new one
+ * over it, which a watch on the directory sees.
+ */
+int clock_zone_watch(void) {
+  int fd;
+
+  if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+    perror("inotify_init1() failed!");
+    return -1;
+  }
+
+  if (inotify_add_watch(fd, CLOCK_ZONE_DIR,
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                            IN_DELETE) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  zone_watched = 1;
+  return fd;
+}
+
+/* Drain the pending events; whether the timezone may have changed */
+int8_t clock_zone_read(int fd) {
+  union {
+    struct inotify_event event; // for the alignment
+    char bytes[CLOCK_EVENT_BUFFER_LEN];
+  } buffer;
+  const struct inotify_event *event;
+  ssize_t count, offset;
+  int8_t changed = 0;
+
+  while ((count = read(fd, buffer.bytes, sizeof(buffer.bytes))) > 0) {
+    for (offset = 0; offset < count;
+         offset += sizeof(*event) + event->len) {
+      event = (const struct inotify_event *)(buffer.bytes + offset);
+
+      if (event->len && strcmp(event->name, CLOCK_ZONE_FILE) == 0) {
+        changed = 1;
+      }
+    }
+  }
+
+  if (changed) {
+    zone_changed = 1;
+    valid_until = 0;
+  }
+
+  return changed;
+}
+
+/*
+ * Broken down local time. localtime_r() only runs once per
+ * CLOCK_REVALIDATE_SECONDS window, which can never contain a local midnight
+ * or a DST switch; inside the window the fields are advanced with a few
+ * divisions. The zone itself is only looked up again when /etc/localtime
+ * changes, or every window when it cannot be watched.
+ */
+const struct tm *clock_now(void) {
+  struct timespec ts;
+  time_t now;
+  long seconds;
+
+  /* Not time(): it reads the coarse clock, which lags behind the timer */
+  clock_gettime(CLOCK_REALTIME, &ts);
+  now = ts.tv_sec;
+
+  if (now < cached_time || now >= valid_until) {
+    if (zone_changed || !zone_watched) {
+      tzset(); // localtime_r() alone does not notice a changed timezone
+      zone_changed = 0;
+    }
+    localtime_r(&now, &cached_tm);
+    cached_time = now;
+    valid_until =
+        now - now % CLOCK_REVALIDATE_SECONDS + CLOCK_REVALIDATE_SECONDS;
+    return &cached_tm;
+  }
+
+  seconds = cached_tm.tm_hour * 3600L + cached_tm.tm_min * 60L +
+            cached_tm.tm_sec + (now - cached_time);
+  cached_time = now;
+
+  cached_tm.tm_hour = seconds / 3600;
+  cached_tm.tm_min = seconds / 60 % 60;
+  cached_tm.tm_sec = seconds % 60;
+
+  return &cached_tm;
+}
+
+/* True once for every new local day, including the first call */
+int8_t clock_day_changed(void) {
+  int day = clock_now()->tm_year * 366 + cached_tm.tm_yday;
+
+  if (day == cached_day) {
+    return 0;
+  }
+
+  cached_day = day;
+  return 1;
+}
+
+/* -----DEADLINE----- */
+
+static int64_t deadline = 0; // CLOCK_MONOTONIC milliseconds, 0 for none
+static int8_t deadline_missed = 0; // a collector found no time left
+
+int64_t clock_monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * The time the running collector has to be done by. Collectors that block on
+ * another process (Pulse, D-Bus) wait at most until then; 0 lifts it.
+ */
+void clock_set_deadline(int64_t at) {
+  deadline = at;
+  deadline_missed = 0;
+}
+
+/*
+ * Milliseconds left until the deadline, -1 when there is none. A collector
+ * that is told 0 gives up on what it was waiting for.
+ */
+int clock_deadline_left(void) {
+  int64_t left;
+
+  if (deadline == 0) {
+    return -1;
+  }
+
+  left = deadline - clock_monotonic_ms();
+  if (left <= 0) {
+    deadline_missed = 1;
+    return 0;
+  }
+
+  return (int)left;
+}
+
+/* Whether a collector gave up since the deadline was set */
+int8_t clock_deadline_missed(void) { return deadline_missed; }
@@ -0,0 +1,25 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define CLOCK_REVALIDATE_SECONDS 900 // every UTC offset is a multiple of this
+#define CLOCK_ZONE_DIR "/etc/"
+#define CLOCK_ZONE_FILE "localtime"
+#define CLOCK_EVENT_BUFFER_LEN 4096
+
+int clock_open(int seconds);
+void clock_set_period(int fd, int seconds);
+int8_t clock_read(int fd);
+int clock_zone_watch(void);
+int8_t clock_zone_read(int fd);
+const struct tm *clock_now(void);
+int8_t clock_day_changed(void);
+
+int64_t clock_monotonic_ms(void);
+void clock_set_deadline(int64_t at);
+int clock_deadline_left(void);
+int8_t clock_deadline_missed(void);
+
+#endif // CLOCK_H
@@ -0,0 +1,296 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/*
+ * A small `key = value` file with the same settings as the command line:
+ *
+ *   # comments and blank lines are ignored
+ *   format = {cpu} | {mem} | {time}
+ *   interval = 5
+ *   deadline = 20
+ *   deadline.volume = 5
+ *   sensors = Tctl,Composite
+ *   disks = nvme0n1
+ *   interfaces = !tailscale*
+ *   headphones = earbuds,AirPods
+ *
+ * It is watched with inotify so edits apply without a restart.
+ */
+
+static char config_path[CONFIG_PATH_LEN] = "";
+
+void config_set_path(const char *path) {
+  snprintf(config_path, sizeof(config_path), "%s", path);
+}
+
+static int8_t resolve_path(void) {
+  const char *dir;
+
+  if (config_path[0] != '\0') {
+    return 1;
+  }
+
+  if ((dir = getenv("XDG_CONFIG_HOME")) != NULL && dir[0] != '\0') {
+    snprintf(config_path, sizeof(config_path), "%s%s", dir, CONFIG_FILE);
+  } else if ((dir = getenv("HOME")) != NULL) {
+    snprintf(config_path, sizeof(config_path), "%s/.config%s", dir,
+             CONFIG_FILE);
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+static char *trim(char *s) {
+  char *end;
+
+  while (*s == ' ' || *s == '\t') {
+    s++;
+  }
+
+  end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+    end--;
+  }
+  *end = '\0';
+
+  return s;
+}
+
+static int8_t copy_value(char *dst, size_t size, const char *value,
+                         int line) {
+  if (strlen(value) >= size) {
+    fprintf(stderr, "%s:%d: value too long\n", config_path, line);
+    return 0;
+  }
+
+  strcpy(dst, value);
+  return 1;
+}
+
+/* The module name is only checked once the config is applied */
+static int8_t parse_deadline(struct config *config, const char *module,
+                             const char *value, int line) {
+  struct config_deadline *deadline;
+
+  if (config->deadline_count == CONFIG_MAX_DEADLINES) {
+    fprintf(stderr, "%s:%d: more than %d module deadlines\n", config_path,
+            line, CONFIG_MAX_DEADLINES);
+    return 0;
+  }
+
+  deadline = &config->deadlines[config->deadline_count];
+  if (!copy_value(deadline->module, sizeof(deadline->module), module, line)) {
+    return 0;
+  }
+  if ((deadline->deadline = atoi(value)) <= 0) {
+    fprintf(stderr, "%s:%d: invalid deadline\n", config_path, line);
+    return 0;
+  }
+
+  config->deadline_count++;
+  return 1;
+}
+
+static int8_t parse_line(struct config *config, char *text, int line) {
+  char *key, *value, *equals;
+
+  if ((equals = strchr(text, '=')) == NULL) {
+    fprintf(stderr, "%s:%d: expected key = value\n", config_path, line);
+    return 0;
+  }
+
+  *equals = '\0';
+  key = trim(text);
+  value = trim(equals + 1);
+
+  if (strcmp(key, "format") == 0) {
+    return copy_value(config->format, sizeof(config->format), value, line);
+  } else if (strcmp(key, "interval") == 0) {
+    if ((config->interval = atoi(value)) <= 0) {
+      fprintf(stderr, "%s:%d: invalid interval\n", config_path, line);
+      return 0;
+    }
+    return 1;
+  } else if (strcmp(key, "deadline") == 0) {
+    if ((config->deadline = atoi(value)) <= 0) {
+      fprintf(stderr, "%s:%d: invalid deadline\n", config_path, line);
+      return 0;
+    }
+    return 1;
+  } else if (strncmp(key, CONFIG_DEADLINE_KEY,
+                     strlen(CONFIG_DEADLINE_KEY)) == 0) {
+    return parse_deadline(config, key + strlen(CONFIG_DEADLINE_KEY), value,
+                          line);
+  } else if (strcmp(key, "sensors") == 0) {
+    return copy_value(config->sensors, sizeof(config->sensors), value, line);
+  } else if (strcmp(key, "disks") == 0) {
+    return copy_value(config->disks, sizeof(config->disks), value, line);
+  } else if (strcmp(key, "interfaces") == 0) {
+    return copy_value(config->interfaces, sizeof(config->interfaces), value,
+                      line);
+  } else if (strcmp(key, "headphones") == 0) {
+    return copy_value(config->headphones, sizeof(config->headphones), value,
+                      line);
+  }
+
+  fprintf(stderr, "%s:%d: unknown key %s\n", config_path, line, key);
+  return 0;
+}
+
+/*
+ * Parse the config file into `config`. A missing file is an empty config;
+ * returns 0 with a message on stderr when the file is invalid.
+ */
+int8_t config_load(struct config *config) {
+  char buffer[CONFIG_BUFFER_LEN];
+  char *text, *newline;
+  ssize_t count;
+  int fd, line = 0;
+
+  memset(config, 0, sizeof(*config));
+
+  if (!resolve_path()) {
+    return 1;
+  }
+
+  if ((fd = open(config_path, O_RDONLY | O_CLOEXEC)) == -1) {
+    if (errno == ENOENT) {
+      return 1;
+    }
+    perror("open() failed!");
+    return 0;
+  }
+
+  count = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+
+  if (count == -1) {
+    perror("read() failed!");
+    return 0;
+  }
+  if (count == sizeof(buffer) - 1) {
+    fprintf(stderr, "%s: larger than %d bytes\n", config_path,
+            CONFIG_BUFFER_LEN - 1);
+    return 0;
+  }
+  buffer[count] = '\0';
+
+  for (text = buffer; text != NULL; text = newline) {
+    if ((newline = strchr(text, '\n')) != NULL) {
+      *newline++ = '\0';
+    }
+    line++;
+
+    text = trim(text);
+    if (text[0] == '\0' || text[0] == '#') {
+      continue;
+    }
+
+    if (!parse_line(config, text, line)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Settings given on the command line win over the file */
+void config_merge(struct config *config, const struct config *overrides) {
+  if (overrides->format[0] != '\0') {
+    strcpy(config->format, overrides->format);
+  }
+  if (overrides->interval > 0) {
+    config->interval = overrides->interval;
+  }
+  if (overrides->deadline > 0) {
+    config->deadline = overrides->deadline;
+  }
+  if (overrides->sensors[0] != '\0') {
+    strcpy(config->sensors, overrides->sensors);
+  }
+  if (overrides->disks[0] != '\0') {
+    strcpy(config->disks, overrides->disks);
+  }
+  if (overrides->interfaces[0] != '\0') {
+    strcpy(config->interfaces, overrides->interfaces);
+  }
+  if (overrides->headphones[0] != '\0') {
+    strcpy(config->headphones, overrides->headphones);
+  }
+}
+
+/*
+ * inotify descriptor for the directory holding the config file, -1 when
+ * there is none. Watching the directory also catches editors that save by
+ * renaming a new file over the old one.
+ */
+int config_watch(void) {
+  char dir[CONFIG_PATH_LEN];
+  char *slash;
+  int fd;
+
+  if (!resolve_path()) {
+    return -1;
+  }
+
+  strcpy(dir, config_path);
+  if ((slash = strrchr(dir, '/')) == NULL) {
+    strcpy(dir, ".");
+  } else if (slash == dir) {
+    slash[1] = '\0';
+  } else {
+    *slash = '\0';
+  }
+
+  if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+    perror("inotify_init1() failed!");
+    return -1;
+  }
+
+  if (inotify_add_watch(fd, dir,
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Drain the pending events; whether any of them was for the config file */
+int8_t config_changed(int fd) {
+  union {
+    struct inotify_event event; // for the alignment
+    char bytes[CONFIG_EVENT_BUFFER_LEN];
+  } buffer;
+  const struct inotify_event *event;
+  const char *name = strrchr(config_path, '/');
+  int8_t changed = 0;
+  ssize_t count, offset;
+
+  name = name ? name + 1 : config_path;
+
+  while ((count = read(fd, buffer.bytes, sizeof(buffer.bytes))) > 0) {
+    for (offset = 0; offset < count;
+         offset += sizeof(*event) + event->len) {
+      event = (const struct inotify_event *)(buffer.bytes + offset);
+
+      if (event->len && strcmp(event->name, name) == 0) {
+        changed = 1;
+      }
+    }
+  }
+
+  return changed;
+}
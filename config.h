@@ -0,0 +1,45 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+#include "format.h"
+
+#define CONFIG_FILE "/status/config" // under $XDG_CONFIG_HOME or ~/.config
+#define CONFIG_PATH_LEN 512
+#define CONFIG_BUFFER_LEN 4096
+#define CONFIG_VALUE_LEN 256
+#define CONFIG_EVENT_BUFFER_LEN 4096
+#define CONFIG_NAME_LEN 32
+#define CONFIG_MAX_DEADLINES 16
+#define CONFIG_DEADLINE_KEY "deadline." // followed by a module name
+
+/* One `deadline.<module> = ms` line */
+struct config_deadline {
+  char module[CONFIG_NAME_LEN];
+  int deadline;
+};
+
+/*
+ * Everything that can change without restarting; empty or 0 means unset.
+ * Recordings keep it as it is, so new settings go at the end.
+ */
+struct config {
+  char format[FORMAT_TEXT_LEN];
+  int interval;
+  int deadline; // milliseconds the refreshes of one frame may take
+  char sensors[CONFIG_VALUE_LEN];
+  char disks[CONFIG_VALUE_LEN];
+  char interfaces[CONFIG_VALUE_LEN];
+  char headphones[CONFIG_VALUE_LEN];
+  struct config_deadline deadlines[CONFIG_MAX_DEADLINES]; // of single modules
+  uint8_t deadline_count;
+};
+
+void config_set_path(const char *path);
+int8_t config_load(struct config *config);
+void config_merge(struct config *config, const struct config *overrides);
+int config_watch(void);
+int8_t config_changed(int fd);
+
+#endif // CONFIG_H
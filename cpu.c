@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "arena.h"
+#include "cpu.h"
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* Jiffies of one "cpu" line, reduced to what a busy percentage needs */
+struct cpu_times {
+  uint64_t busy;
+  uint64_t total;
+  uint8_t usage; // percent over the last two samples
+};
+
+static int stat_fd = -1;
+static char *stat_buffer;
+
+static struct cpu_times total_times;
+static struct cpu_times *core_times;
+static uint16_t core_count = 0;
+
+static int8_t cpu_open(void) {
+  if (stat_fd >= 0) {
+    return 1;
+  }
+
+  if ((stat_fd = replay_open(PROC_STAT_FILE, O_RDONLY | O_CLOEXEC)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  stat_buffer = arena_alloc(CPU_STAT_BUFFER_LEN);
+  core_times = arena_alloc(CPU_MAX_CORES * sizeof(*core_times));
+
+  return 1;
+}
+
+static const char *skip_spaces(const char *p) {
+  while (*p == ' ') {
+    p++;
+  }
+  return p;
+}
+
+static const char *parse_u64(const char *p, uint64_t *value) {
+  uint64_t v = 0;
+
+  while ((unsigned)(*p - '0') < 10) {
+    v = v * 10 + (*p++ - '0');
+  }
+
+  *value = v;
+  return p;
+}
+
+/*
+ * user nice system idle iowait irq softirq steal; guest time is already part
+ * of user, so the remaining columns are skipped.
+ */
+static const char *parse_times(const char *p, struct cpu_times *times) {
+  uint64_t value, busy = 0, total = 0, delta_busy, delta_total;
+  int column;
+
+  for (column = 0; column < 8 && *p != '\n' && *p != '\0'; column++) {
+    p = parse_u64(skip_spaces(p), &value);
+    total += value;
+    if (column != 3 && column != 4) { // idle and iowait
+      busy += value;
+    }
+  }
+
+  while (*p != '\n' && *p != '\0') {
+    p++;
+  }
+
+  if (*p != '\n') { // cut off by the read, keep the previous sample
+    return p;
+  }
+
+  delta_busy = busy - times->busy;
+  delta_total = total - times->total;
+
+  if (!times->total && total) { // first sample: average since boot
+    times->usage = (uint8_t)(busy * 100 / total);
+  } else if (total > times->total && busy >= times->busy) {
+    times->usage = (uint8_t)((delta_busy * 100 + delta_total / 2) /
+                             delta_total);
+  }
+
+  times->busy = busy;
+  times->total = total;
+
+  return p;
+}
+
+/*
+ * One pread() of the whole buffer per sample. Only the cpu lines at the top
+ * of /proc/stat are parsed, but a shorter read would not save anything: the
+ * kernel prints the whole file for every read, and a read that stops short
+ * silently cuts off the line of a CPU that was just brought online.
+ */
+int8_t cpu_sample(void) {
+  const char *p;
+  uint64_t core;
+  ssize_t count;
+
+  if (!cpu_open()) {
+    return 0;
+  }
+
+  if ((count = replay_pread(stat_fd, stat_buffer, CPU_STAT_BUFFER_LEN)) <= 0) {
+    return 0;
+  }
+  stat_buffer[count == CPU_STAT_BUFFER_LEN ? count - 1 : count] = '\0';
+
+  p = stat_buffer;
+  core_count = 0;
+
+  while (p[0] == 'c' && p[1] == 'p' && p[2] == 'u') {
+    if (p[3] == ' ') {
+      p = parse_times(p + 3, &total_times);
+    } else {
+      p = parse_u64(p + 3, &core);
+      if (core < CPU_MAX_CORES) {
+        p = parse_times(p, &core_times[core]);
+        if (core >= core_count) {
+          core_count = core + 1;
+        }
+      }
+    }
+
+    if (*p != '\n') { // the cpu lines ran past the buffer
+      return 1;
+    }
+    p++;
+  }
+
+  return 1;
+}
+
+uint8_t cpu_total_usage(void) { return total_times.usage; }
+
+uint16_t cpu_core_count(void) { return core_count; }
+
+uint8_t cpu_core_usage(uint16_t core) {
+  return core < core_count ? core_times[core].usage : 0;
+}
@@ -0,0 +1,15 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+#define PROC_STAT_FILE "/proc/stat"
+#define CPU_MAX_CORES 1024
+#define CPU_STAT_BUFFER_LEN (128 * 1024)
+
+int8_t cpu_sample(void);
+uint8_t cpu_total_usage(void);
+uint16_t cpu_core_count(void);
+uint8_t cpu_core_usage(uint16_t core);
+
+#endif // CPU_H
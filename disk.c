@@ -0,0 +1,307 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "arena.h"
+#include "disk.h"
+#include "replay.h"
+#include "sysfs.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * /proc/diskstats lists every block device in the same order on each read,
+ * so a device is identified by its line number ("slot") and the fixed width
+ * major:minor columns at the start of that line. A sample compares those 13
+ * bytes, skips lines of devices nobody asked for with one memchr(), and only
+ * parses the counters of the selected ones. A mismatch, or a line past the
+ * known ones, means a device came or went, and the slots are built again.
+ */
+
+/* Not disks of their own, or already counted through their members */
+static const char *virtual_prefixes[] = {"loop", "ram", "zram", "dm-", "md",
+                                         "sr",   "fd"};
+
+#define VIRTUAL_PREFIX_COUNT                                                   \
+  (sizeof(virtual_prefixes) / sizeof(virtual_prefixes[0]))
+
+static char selection[DISK_SELECTION_LEN];
+static const char *selectors[DISK_MAX_SELECTORS];
+static uint8_t selector_count = 0;
+
+static int diskstats_fd = -1;
+static char *diskstats;
+
+static struct disk_slot *slots;
+static uint16_t slot_count = 0;
+static uint16_t walk_count = 0; // slots up to the last selected one
+static int8_t discovered = 0;
+
+static int64_t sampled_at;
+static uint64_t read_rate, write_rate;
+
+/* Comma separated device names, e.g. "nvme0n1,sda" */
+void disk_select(const char *names) {
+  char *name;
+
+  strncpy(selection, names, sizeof(selection) - 1);
+  name = strtok(selection, ",");
+
+  selector_count = 0;
+
+  while (name && selector_count < DISK_MAX_SELECTORS) {
+    selectors[selector_count++] = name;
+    name = strtok(NULL, ",");
+  }
+}
+
+/* Build the slots again on the next sample, e.g. for a new selection */
+void disk_invalidate(void) { discovered = 0; }
+
+static int8_t disk_open(void) {
+  if (diskstats_fd >= 0) {
+    return 1;
+  }
+
+  if ((diskstats_fd = replay_open(PROC_DISKSTATS_FILE,
+                                  O_RDONLY | O_CLOEXEC)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  diskstats = arena_alloc(DISKSTATS_BUFFER_LEN);
+  slots = arena_alloc(DISK_MAX_SLOTS * sizeof(*slots));
+
+  return 1;
+}
+
+static const char *parse_u64(const char *p, uint64_t *value) {
+  uint64_t v = 0;
+
+  while (*p == ' ') {
+    p++;
+  }
+
+  while ((unsigned)(*p - '0') < 10) {
+    v = v * 10 + (*p++ - '0');
+  }
+
+  *value = v;
+  return p;
+}
+
+/* Sectors read and written, from the counters following the device name */
+static const char *parse_sectors(const char *p, uint64_t *read_sectors,
+                                 uint64_t *write_sectors) {
+  uint64_t ignored;
+
+  while (*p != ' ' && *p != '\n' && *p != '\0') {
+    p++;
+  }
+
+  p = parse_u64(p, &ignored);       // reads completed
+  p = parse_u64(p, &ignored);       // reads merged
+  p = parse_u64(p, read_sectors);   // sectors read
+  p = parse_u64(p, &ignored);       // time reading
+  p = parse_u64(p, &ignored);       // writes completed
+  p = parse_u64(p, &ignored);       // writes merged
+  return parse_u64(p, write_sectors); // sectors written
+}
+
+static int8_t is_selected(const char *name) {
+  size_t i;
+  int fd;
+
+  if (selector_count > 0) {
+    for (i = 0; i < selector_count; i++) {
+      if (strcmp(selectors[i], name) == 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  for (i = 0; i < VIRTUAL_PREFIX_COUNT; i++) {
+    if (strncmp(name, virtual_prefixes[i], strlen(virtual_prefixes[i])) ==
+        0) {
+      return 0;
+    }
+  }
+
+  /* Partitions would count the traffic of their disk twice */
+  if ((fd = sysfs_open(SYS_BLOCK_DIR, name, BLOCK_PARTITION_FILE)) >= 0) {
+    replay_close(fd);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Build the slots from a complete read of `len` bytes */
+static void discover(size_t len) {
+  const char *p = diskstats, *end = diskstats + len, *line_end, *name;
+  struct disk_slot *slot;
+  size_t name_len;
+
+  slot_count = 0;
+  walk_count = 0;
+
+  while (p < end && slot_count < DISK_MAX_SLOTS &&
+         (line_end = memchr(p, '\n', end - p)) != NULL) {
+    slot = &slots[slot_count++];
+
+    if (line_end - p < DISK_ID_LEN) {
+      memset(slot, 0, sizeof(*slot));
+      p = line_end + 1;
+      continue;
+    }
+
+    memcpy(slot->id, p, DISK_ID_LEN);
+    slot->read_rate = slot->write_rate = 0;
+
+    name = p + DISK_ID_LEN;
+    while (*name == ' ') {
+      name++;
+    }
+    name_len = 0;
+    while (name + name_len < line_end && name[name_len] != ' ') {
+      name_len++;
+    }
+    if (name_len >= sizeof(slot->name)) {
+      name_len = sizeof(slot->name) - 1;
+    }
+    memcpy(slot->name, name, name_len);
+    slot->name[name_len] = '\0';
+
+    if ((slot->selected = is_selected(slot->name))) {
+      parse_sectors(name, &slot->read_sectors, &slot->write_sectors);
+      walk_count = slot_count;
+    }
+
+    p = line_end + 1;
+  }
+
+  discovered = 1;
+}
+
+static ssize_t read_diskstats(void) {
+  ssize_t count;
+
+  if ((count = replay_pread(diskstats_fd, diskstats,
+                            DISKSTATS_BUFFER_LEN - 1)) < 0) {
+    return -1;
+  }
+
+  diskstats[count] = '\0';
+  return count;
+}
+
+/* Start over from a full read; the rates of this sample are unknown */
+static int8_t rediscover(void) {
+  ssize_t count;
+
+  if ((count = read_diskstats()) < 0) {
+    return 0;
+  }
+
+  discover(count);
+  sampled_at = replay_clock_ms();
+  read_rate = write_rate = 0;
+
+  return 1;
+}
+
+int8_t disk_sample(void) {
+  uint64_t read_total = 0, write_total = 0, read_sectors, write_sectors;
+  uint64_t read_delta, write_delta;
+  const char *p, *end, *line_end;
+  struct disk_slot *slot;
+  int64_t now, elapsed;
+  ssize_t count;
+  uint16_t i;
+
+  if (!disk_open()) {
+    return 0;
+  }
+
+  if (!discovered) {
+    return rediscover();
+  }
+
+  if ((count = read_diskstats()) < 0) {
+    return 0;
+  }
+
+  /* Taken after the read, which is when a replay advances its clock */
+  now = replay_clock_ms();
+
+  p = diskstats;
+  end = diskstats + count;
+
+  for (i = 0; i < slot_count; i++) {
+    slot = &slots[i];
+
+    if (end - p < DISK_ID_LEN || memcmp(p, slot->id, DISK_ID_LEN) != 0 ||
+        (line_end = memchr(p, '\n', end - p)) == NULL) {
+      return rediscover();
+    }
+
+    if (slot->selected) {
+      parse_sectors(p + DISK_ID_LEN, &read_sectors, &write_sectors);
+
+      /* Counters go back to zero when a device is reset */
+      read_delta = read_sectors >= slot->read_sectors
+                       ? read_sectors - slot->read_sectors
+                       : 0;
+      write_delta = write_sectors >= slot->write_sectors
+                        ? write_sectors - slot->write_sectors
+                        : 0;
+
+      if ((elapsed = now - sampled_at) > 0) {
+        slot->read_rate = read_delta * DISK_SECTOR_SIZE * 1000 / elapsed;
+        slot->write_rate = write_delta * DISK_SECTOR_SIZE * 1000 / elapsed;
+      }
+
+      read_total += read_delta;
+      write_total += write_delta;
+      slot->read_sectors = read_sectors;
+      slot->write_sectors = write_sectors;
+    }
+
+    p = line_end + 1;
+  }
+
+  /* A line past the known ones is a new device */
+  if (slot_count < DISK_MAX_SLOTS && memchr(p, '\n', end - p) != NULL) {
+    return rediscover();
+  }
+
+  if ((elapsed = now - sampled_at) > 0) {
+    read_rate = read_total * DISK_SECTOR_SIZE * 1000 / elapsed;
+    write_rate = write_total * DISK_SECTOR_SIZE * 1000 / elapsed;
+  }
+  sampled_at = now;
+
+  return 1;
+}
+
+/* Bytes per second over the last two samples, summed over the selection */
+uint64_t disk_read_rate(void) { return read_rate; }
+
+uint64_t disk_write_rate(void) { return write_rate; }
+
+/*
+ * The next selected device after `*cursor`, in /proc/diskstats order, with
+ * its own rates; start with a cursor of 0. NULL after the last one.
+ */
+const struct disk_slot *disk_next_selected(uint16_t *cursor) {
+  while (*cursor < walk_count) {
+    if (slots[(*cursor)++].selected) {
+      return &slots[*cursor - 1];
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include <stdint.h>
+
+#define PROC_DISKSTATS_FILE "/proc/diskstats"
+#define SYS_BLOCK_DIR "/sys/class/block/"
+#define BLOCK_PARTITION_FILE "/partition"
+#define DISK_MAX_SLOTS 1024
+#define DISK_MAX_SELECTORS 8
+#define DISK_SELECTION_LEN 256
+#define DISK_NAME_LEN 32
+#define DISK_ID_LEN 13 // "%4u %7u " major and minor columns of a line
+#define DISK_SECTOR_SIZE 512
+#define DISKSTATS_BUFFER_LEN (128 * 1024)
+
+/* One line of /proc/diskstats, found by its position in the file */
+struct disk_slot {
+  char id[DISK_ID_LEN];
+  char name[DISK_NAME_LEN];
+  uint8_t selected;
+  uint64_t read_sectors;
+  uint64_t write_sectors;
+  uint64_t read_rate; // bytes per second over the last two samples
+  uint64_t write_rate;
+};
+
+void disk_select(const char *names);
+void disk_invalidate(void);
+int8_t disk_sample(void);
+uint64_t disk_read_rate(void);
+uint64_t disk_write_rate(void);
+const struct disk_slot *disk_next_selected(uint16_t *cursor);
+
+#endif // DISK_H
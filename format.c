@@ -0,0 +1,579 @@
+#include "format.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_DATE_SPEC "%a, %b %d"
+#define DEFAULT_TIME_SPEC "%H:%M:%S"
+
+static const char *field_names[FIELD_COUNT] = {
+    [FIELD_VOL] = "vol",
+    [FIELD_MIC] = "mic",
+    [FIELD_BACKLIGHT] = "backlight",
+    [FIELD_BAT] = "bat",
+    [FIELD_BAT_TIME] = "bat_time",
+    [FIELD_NET] = "net",
+    [FIELD_NET_DOWN] = "net_down",
+    [FIELD_NET_UP] = "net_up",
+    [FIELD_NET_GRAPH] = "net_graph",
+    [FIELD_NET_PEAK] = "net_peak",
+    [FIELD_NET_WIRED] = "net_wired",
+    [FIELD_NET_WIFI] = "net_wifi",
+    [FIELD_NET_VPN] = "net_vpn",
+    [FIELD_WIFI_SSID] = "wifi_ssid",
+    [FIELD_WIFI_SIGNAL] = "wifi_signal",
+    [FIELD_WIFI_BITRATE] = "wifi_bitrate",
+    [FIELD_BT] = "bt",
+    [FIELD_CPU] = "cpu",
+    [FIELD_CPU_BARS] = "cpu_bars",
+    [FIELD_MEM] = "mem",
+    [FIELD_MEM_AVAIL] = "mem_avail",
+    [FIELD_SWAP] = "swap",
+    [FIELD_ZSWAP] = "zswap",
+    [FIELD_TEMP] = "temp",
+    [FIELD_FAN] = "fan",
+    [FIELD_DISK] = "disk",
+    [FIELD_DISK_READ] = "disk_read",
+    [FIELD_DISK_WRITE] = "disk_write",
+    [FIELD_DISKS] = "disks",
+    [FIELD_PSI] = "psi",
+    [FIELD_DATE] = "date",
+    [FIELD_TIME] = "time",
+};
+
+static const char *days_of_week[] = {"Sunday",   "Monday", "Tuesday",
+                                     "Wednesday", "Thursday", "Friday",
+                                     "Saturday"};
+
+static const char *months_of_year[] = {
+    "January", "February", "March",     "April",   "May",      "June",
+    "July",    "August",   "September", "October", "November", "December"};
+
+static int8_t add_op(struct format *format, uint8_t type, size_t offset,
+                     size_t len) {
+  struct format_op *op;
+
+  if (format->count == FORMAT_MAX_OPS) {
+    return 0;
+  }
+
+  op = &format->ops[format->count++];
+  op->type = type;
+  op->field = 0;
+  op->width = 0;
+  op->precision = -1;
+  op->offset = offset;
+  op->len = len;
+
+  return 1;
+}
+
+/* Extend the previous literal op when spans are adjacent */
+static int8_t add_literal(struct format *format, size_t offset, size_t len) {
+  struct format_op *last;
+
+  if (format->count > 0) {
+    last = &format->ops[format->count - 1];
+    if (last->type == OP_LITERAL && last->offset + last->len == offset) {
+      last->len += len;
+      return 1;
+    }
+  }
+
+  return add_op(format, OP_LITERAL, offset, len);
+}
+
+/* Turn the strftime() subset in text[start, end) into clock ops */
+static int8_t compile_clock(struct format *format, size_t start, size_t end,
+                            size_t *error_offset) {
+  size_t i = start, run = start;
+  uint8_t type;
+
+  while (i < end) {
+    if (format->text[i] != '%') {
+      i++;
+      continue;
+    }
+
+    if (i > run && !add_literal(format, run, i - run)) {
+      *error_offset = i;
+      return 0;
+    }
+
+    if (i + 1 == end) {
+      *error_offset = i;
+      return 0;
+    }
+
+    switch (format->text[i + 1]) {
+    case '%':
+      if (!add_literal(format, i + 1, 1)) {
+        *error_offset = i;
+        return 0;
+      }
+      run = i += 2;
+      continue;
+    case 'a':
+      type = OP_WEEKDAY_ABBR;
+      break;
+    case 'A':
+      type = OP_WEEKDAY;
+      break;
+    case 'b':
+      type = OP_MONTH_ABBR;
+      break;
+    case 'B':
+      type = OP_MONTH;
+      break;
+    case 'd':
+      type = OP_DAY;
+      break;
+    case 'e':
+      type = OP_DAY_PADDED;
+      break;
+    case 'm':
+      type = OP_MONTH_NUMBER;
+      break;
+    case 'Y':
+      type = OP_YEAR;
+      break;
+    case 'y':
+      type = OP_YEAR_SHORT;
+      break;
+    case 'H':
+      type = OP_HOUR;
+      break;
+    case 'I':
+      type = OP_HOUR_12;
+      break;
+    case 'M':
+      type = OP_MINUTE;
+      break;
+    case 'S':
+      type = OP_SECOND;
+      break;
+    case 'p':
+      type = OP_AM_PM;
+      break;
+    default:
+      *error_offset = i;
+      return 0;
+    }
+
+    if (!add_op(format, type, 0, 0)) {
+      *error_offset = i;
+      return 0;
+    }
+
+    run = i += 2;
+  }
+
+  if (end > run && !add_literal(format, run, end - run)) {
+    *error_offset = run;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Parse "[-]width[.precision]" in text[start, end) */
+static int8_t parse_width(struct format *format, struct format_op *op,
+                          size_t start, size_t end) {
+  char *p = format->text + start, *stop;
+
+  if (start == end) {
+    return 1;
+  }
+
+  if (*p != '.') {
+    op->width = strtol(p, &stop, 10);
+    p = stop;
+  }
+
+  if (*p == '.') {
+    op->precision = strtol(p + 1, &stop, 10);
+    if (stop == p + 1) {
+      return 0;
+    }
+    p = stop;
+  }
+
+  return p == format->text + end;
+}
+
+/* Append a default clock spec behind the template so ops can point at it */
+static int8_t append_text(struct format *format, size_t *len,
+                          const char *text) {
+  size_t text_len = strlen(text);
+
+  if (*len + text_len >= sizeof(format->text)) {
+    return 0;
+  }
+
+  memcpy(format->text + *len, text, text_len + 1);
+  *len += text_len;
+
+  return 1;
+}
+
+int8_t format_compile(const char *spec, struct format *format,
+                      size_t *error_offset) {
+  size_t len = strlen(spec), text_len, i = 0, run = 0, name, colon, close;
+  uint8_t field;
+
+  format->count = 0;
+  format->fields = 0;
+  *error_offset = 0;
+
+  if (len >= sizeof(format->text)) {
+    *error_offset = sizeof(format->text) - 1;
+    return 0;
+  }
+
+  memcpy(format->text, spec, len + 1);
+  text_len = len;
+
+  while (i < len) {
+    char c = format->text[i];
+
+    if (c != '{' && c != '}') {
+      i++;
+      continue;
+    }
+
+    if (i > run && !add_literal(format, run, i - run)) {
+      *error_offset = i;
+      return 0;
+    }
+
+    /* "{{" and "}}" stand for a literal brace */
+    if (i + 1 < len && format->text[i + 1] == c) {
+      if (!add_literal(format, i, 1)) {
+        *error_offset = i;
+        return 0;
+      }
+      run = i += 2;
+      continue;
+    }
+
+    if (c == '}') {
+      *error_offset = i;
+      return 0;
+    }
+
+    name = i + 1;
+    for (colon = name; colon < len && format->text[colon] != ':' &&
+                       format->text[colon] != '}';
+         colon++)
+      ;
+    for (close = colon; close < len && format->text[close] != '}'; close++)
+      ;
+
+    if (close == len) {
+      *error_offset = i;
+      return 0;
+    }
+
+    for (field = 0; field < FIELD_COUNT; field++) {
+      if (strlen(field_names[field]) == colon - name &&
+          strncmp(format->text + name, field_names[field], colon - name) ==
+              0) {
+        break;
+      }
+    }
+
+    if (field == FIELD_COUNT) {
+      *error_offset = name;
+      return 0;
+    }
+
+    format->fields |= FIELD_BIT(field);
+
+    if (field == FIELD_DATE || field == FIELD_TIME) {
+      size_t start = colon + 1, end = close;
+      uint16_t first = format->count;
+
+      if (colon == close) {
+        start = text_len;
+        if (!append_text(format, &text_len,
+                         field == FIELD_DATE ? DEFAULT_DATE_SPEC
+                                             : DEFAULT_TIME_SPEC)) {
+          *error_offset = i;
+          return 0;
+        }
+        end = text_len;
+      }
+
+      if (!compile_clock(format, start, end, error_offset)) {
+        return 0;
+      }
+
+      /* Mark the ops of this spec, so the clock blocks can find them */
+      for (; first < format->count; first++) {
+        format->ops[first].field = field;
+      }
+    } else {
+      if (!add_op(format, OP_FIELD, 0, 0) ||
+          !parse_width(format, &format->ops[format->count - 1],
+                       colon == close ? close : colon + 1, close)) {
+        *error_offset = colon;
+        return 0;
+      }
+      format->ops[format->count - 1].field = field;
+    }
+
+    run = i = close + 1;
+  }
+
+  if (len > run && !add_literal(format, run, len - run)) {
+    *error_offset = run;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Whether the output changes every second rather than every minute */
+int8_t format_has_seconds(const struct format *format) {
+  uint16_t i;
+
+  for (i = 0; i < format->count; i++) {
+    if (format->ops[i].type == OP_SECOND) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * The clock ops of the first {date} or {time} in `format`, as a format of
+ * their own, for the i3bar blocks that show just the date or time.
+ */
+void format_clock(const struct format *format, uint8_t field,
+                  struct format *clock) {
+  uint16_t i = 0;
+
+  memcpy(clock->text, format->text, sizeof(clock->text));
+  clock->count = 0;
+  clock->fields = FIELD_BIT(field);
+
+  while (i < format->count && (format->ops[i].type == OP_FIELD ||
+                               format->ops[i].field != field)) {
+    i++;
+  }
+
+  while (i < format->count && format->ops[i].type != OP_FIELD &&
+         format->ops[i].field == field) {
+    clock->ops[clock->count++] = format->ops[i++];
+  }
+}
+
+static int8_t same_op(const struct format *format, const struct format_op *a,
+                      const struct format_op *b) {
+  if (a->type != b->type) {
+    return 0;
+  }
+
+  return a->type != OP_LITERAL ||
+         (a->len == b->len && memcmp(format->text + a->offset,
+                                     format->text + b->offset, a->len) == 0);
+}
+
+/* The date block is formatted once a day, so it cannot stand in for these */
+static int8_t is_time_of_day(uint8_t type) {
+  return type == OP_HOUR || type == OP_HOUR_12 || type == OP_MINUTE ||
+         type == OP_SECOND || type == OP_AM_PM;
+}
+
+/*
+ * Turn every {date} or {time} spec in `format` that renders the same as
+ * `clock` (taken with format_clock()) into a plain field, so a frame copies
+ * the text of the date or time block instead of formatting the clock again.
+ * Other specs of the field stay clock ops.
+ */
+void format_share_clock(struct format *format, uint8_t field,
+                        const struct format *clock) {
+  uint16_t i = 0, end, out = 0, k;
+  int8_t shared;
+
+  while (i < format->count) {
+    for (end = i; end < format->count && format->ops[end].type != OP_FIELD &&
+                  format->ops[end].field == field;
+         end++)
+      ;
+
+    if (end == i) {
+      format->ops[out++] = format->ops[i++];
+      continue;
+    }
+
+    shared = end - i == clock->count;
+    for (k = 0; shared && k < clock->count; k++) {
+      shared = same_op(format, &format->ops[i + k], &clock->ops[k]) &&
+               !(field == FIELD_DATE && is_time_of_day(clock->ops[k].type));
+    }
+
+    if (shared) {
+      format->ops[out] = format->ops[i];
+      format->ops[out].type = OP_FIELD;
+      format->ops[out].width = 0;
+      format->ops[out++].precision = -1;
+      i = end;
+      continue;
+    }
+
+    while (i < end) {
+      format->ops[out++] = format->ops[i++];
+    }
+  }
+
+  format->count = out;
+}
+
+static void append(char *buf, size_t size, size_t *len, const char *src,
+                   size_t n) {
+  if (*len + n > size) {
+    n = size - *len;
+  }
+
+  memcpy(buf + *len, src, n);
+  *len += n;
+}
+
+static void append_padding(char *buf, size_t size, size_t *len, int count) {
+  while (count-- > 0 && *len < size) {
+    buf[(*len)++] = ' ';
+  }
+}
+
+static void append_number(char *buf, size_t size, size_t *len, int value,
+                          char pad) {
+  char digits[2] = {value / 10 % 10 + '0', value % 10 + '0'};
+
+  if (pad != '0' && digits[0] == '0') {
+    digits[0] = pad;
+  }
+
+  append(buf, size, len, digits, 2);
+}
+
+/* Byte length of the first `max` UTF-8 characters of `s`, counting them */
+static size_t utf8_prefix(const char *s, int max, int *chars) {
+  size_t i = 0;
+
+  *chars = 0;
+  while (s[i] != '\0') {
+    if (((unsigned char)s[i] & 0xc0) != 0x80) {
+      if (max >= 0 && *chars == max) {
+        break;
+      }
+      (*chars)++;
+    }
+    i++;
+  }
+
+  return i;
+}
+
+static void append_field(char *buf, size_t size, size_t *len,
+                         const struct format_op *op, const char *value) {
+  int chars, width = op->width < 0 ? -op->width : op->width;
+  size_t bytes;
+
+  if (!value) {
+    value = "";
+  }
+
+  bytes = utf8_prefix(value, op->precision, &chars);
+
+  if (op->width > 0) {
+    append_padding(buf, size, len, width - chars);
+  }
+
+  append(buf, size, len, value, bytes);
+
+  if (op->width < 0) {
+    append_padding(buf, size, len, width - chars);
+  }
+}
+
+/*
+ * Render `format` into `buf` without a terminating NUL and return the length.
+ * `values` is indexed by enum FormatField; `tm` is only read by clock ops.
+ */
+/* Render ops[first, end) of `format`, e.g. the part one i3bar block shows */
+size_t format_render_span(const struct format *format, uint16_t first,
+                          uint16_t end, const char *const *values,
+                          const struct tm *tm, char *buf, size_t size) {
+  size_t len = 0;
+  uint16_t i;
+
+  for (i = first; i < end; i++) {
+    const struct format_op *op = &format->ops[i];
+
+    switch (op->type) {
+    case OP_LITERAL:
+      append(buf, size, &len, format->text + op->offset, op->len);
+      break;
+    case OP_FIELD:
+      append_field(buf, size, &len, op, values[op->field]);
+      break;
+    case OP_WEEKDAY_ABBR:
+      append(buf, size, &len, days_of_week[tm->tm_wday], 3);
+      break;
+    case OP_WEEKDAY:
+      append(buf, size, &len, days_of_week[tm->tm_wday],
+             strlen(days_of_week[tm->tm_wday]));
+      break;
+    case OP_MONTH_ABBR:
+      append(buf, size, &len, months_of_year[tm->tm_mon], 3);
+      break;
+    case OP_MONTH:
+      append(buf, size, &len, months_of_year[tm->tm_mon],
+             strlen(months_of_year[tm->tm_mon]));
+      break;
+    case OP_DAY:
+      append_number(buf, size, &len, tm->tm_mday, '0');
+      break;
+    case OP_DAY_PADDED:
+      append_number(buf, size, &len, tm->tm_mday, ' ');
+      break;
+    case OP_MONTH_NUMBER:
+      append_number(buf, size, &len, tm->tm_mon + 1, '0');
+      break;
+    case OP_YEAR:
+      append_number(buf, size, &len, (tm->tm_year + 1900) / 100, '0');
+      append_number(buf, size, &len, tm->tm_year % 100, '0');
+      break;
+    case OP_YEAR_SHORT:
+      append_number(buf, size, &len, tm->tm_year % 100, '0');
+      break;
+    case OP_HOUR:
+      append_number(buf, size, &len, tm->tm_hour, '0');
+      break;
+    case OP_HOUR_12:
+      append_number(buf, size, &len, (tm->tm_hour + 11) % 12 + 1, '0');
+      break;
+    case OP_MINUTE:
+      append_number(buf, size, &len, tm->tm_min, '0');
+      break;
+    case OP_SECOND:
+      append_number(buf, size, &len, tm->tm_sec, '0');
+      break;
+    case OP_AM_PM:
+      append(buf, size, &len, tm->tm_hour < 12 ? "AM" : "PM", 2);
+      break;
+    }
+  }
+
+  return len;
+}
+
+size_t format_render(const struct format *format, const char *const *values,
+                     const struct tm *tm, char *buf, size_t size) {
+  return format_render_span(format, 0, format->count, values, tm, buf, size);
+}
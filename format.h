@@ -0,0 +1,99 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define FORMAT_TEXT_LEN 512
+#define FORMAT_MAX_OPS 128
+
+/* Values a template can reference as {name} or {name:spec} */
+enum FormatField {
+  FIELD_VOL,
+  FIELD_MIC,
+  FIELD_BACKLIGHT,
+  FIELD_BAT,
+  FIELD_BAT_TIME,
+  FIELD_NET,
+  FIELD_NET_DOWN,
+  FIELD_NET_UP,
+  FIELD_NET_GRAPH,
+  FIELD_NET_PEAK,
+  FIELD_NET_WIRED,
+  FIELD_NET_WIFI,
+  FIELD_NET_VPN,
+  FIELD_WIFI_SSID,
+  FIELD_WIFI_SIGNAL,
+  FIELD_WIFI_BITRATE,
+  FIELD_BT,
+  FIELD_CPU,
+  FIELD_CPU_BARS,
+  FIELD_MEM,
+  FIELD_MEM_AVAIL,
+  FIELD_SWAP,
+  FIELD_ZSWAP,
+  FIELD_TEMP,
+  FIELD_FAN,
+  FIELD_DISK,
+  FIELD_DISK_READ,
+  FIELD_DISK_WRITE,
+  FIELD_DISKS,
+  FIELD_PSI,
+  FIELD_DATE,
+  FIELD_TIME,
+  FIELD_COUNT
+};
+
+#define FIELD_BIT(field) (1U << (field))
+
+enum FormatOpType {
+  OP_LITERAL,
+  OP_FIELD,
+  OP_WEEKDAY_ABBR, // %a
+  OP_WEEKDAY,      // %A
+  OP_MONTH_ABBR,   // %b
+  OP_MONTH,        // %B
+  OP_DAY,          // %d
+  OP_DAY_PADDED,   // %e
+  OP_MONTH_NUMBER, // %m
+  OP_YEAR,         // %Y
+  OP_YEAR_SHORT,   // %y
+  OP_HOUR,         // %H
+  OP_HOUR_12,      // %I
+  OP_MINUTE,       // %M
+  OP_SECOND,       // %S
+  OP_AM_PM         // %p
+};
+
+struct format_op {
+  uint8_t type;
+  uint8_t field;     // OP_FIELD's field, or the date/time field of a clock op
+  int16_t width;     // pad to this many characters, negative aligns left
+  int16_t precision; // truncate to this many characters, -1 for no limit
+  uint16_t offset;   // literal span inside format.text
+  uint16_t len;
+};
+
+/* A template compiled once at startup and walked for every frame */
+struct format {
+  char text[FORMAT_TEXT_LEN];
+  struct format_op ops[FORMAT_MAX_OPS];
+  uint16_t count;
+  uint32_t fields; // FIELD_BIT() of every referenced field
+};
+
+int8_t format_compile(const char *spec, struct format *format,
+                      size_t *error_offset);
+int8_t format_has_seconds(const struct format *format);
+void format_clock(const struct format *format, uint8_t field,
+                  struct format *clock);
+void format_share_clock(struct format *format, uint8_t field,
+                        const struct format *clock);
+size_t format_render(const struct format *format, const char *const *values,
+                     const struct tm *tm, char *buf, size_t size);
+size_t format_render_span(const struct format *format, uint16_t first,
+                          uint16_t end, const char *const *values,
+                          const struct tm *tm, char *buf, size_t size);
+
+#endif // FORMAT_H
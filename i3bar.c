@@ -0,0 +1,160 @@
+#include "i3bar.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * The header and the opening "[]" are written once at startup, so every frame
+ * is a continuation of the infinite array and starts with a comma.
+ */
+void i3bar_begin_frame(struct json_writer *writer) {
+  json_raw(writer, ",", 1);
+  json_begin_array(writer);
+}
+
+void i3bar_block(struct json_writer *writer, const char *name,
+                 const struct block *block) {
+  json_begin_object(writer);
+
+  json_key(writer, "name");
+  json_string(writer, name);
+
+  if (block->instance[0] != '\0') {
+    json_key(writer, "instance");
+    json_string(writer, block->instance);
+  }
+
+  json_key(writer, "full_text");
+  json_string(writer, block->full_text);
+
+  if (block->color) {
+    json_key(writer, "color");
+    json_string(writer, block->color);
+  }
+
+  if (block->urgent) {
+    json_key(writer, "urgent");
+    json_bool(writer, 1);
+  }
+
+  json_end_object(writer);
+}
+
+void i3bar_end_frame(struct json_writer *writer) {
+  json_end_array(writer);
+  json_raw(writer, "\n", 1);
+}
+
+/* Point past `"key"` and the following colon, NULL if the key is missing */
+static const char *find_value(const char *line, const char *key) {
+  size_t key_len = strlen(key);
+  const char *p = line;
+
+  while ((p = strchr(p, '"')) != NULL) {
+    p++;
+    if (strncmp(p, key, key_len) == 0 && p[key_len] == '"') {
+      p += key_len + 1;
+      while (*p == ' ' || *p == '\t') {
+        p++;
+      }
+      if (*p != ':') {
+        continue;
+      }
+      p++;
+      while (*p == ' ' || *p == '\t') {
+        p++;
+      }
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+static void copy_string_value(const char *value, char *dest, size_t len) {
+  size_t i = 0;
+
+  dest[0] = '\0';
+
+  if (!value || *value != '"') {
+    return;
+  }
+
+  for (value++; *value && *value != '"' && i < len - 1; value++) {
+    if (*value == '\\' && value[1] != '\0') {
+      value++;
+    }
+    dest[i++] = *value;
+  }
+
+  dest[i] = '\0';
+}
+
+int8_t i3bar_parse_click(const char *line, struct click_event *event) {
+  const char *button;
+
+  copy_string_value(find_value(line, "name"), event->name,
+                    sizeof(event->name));
+  copy_string_value(find_value(line, "instance"), event->instance,
+                    sizeof(event->instance));
+
+  if ((button = find_value(line, "button")) == NULL) {
+    return 0;
+  }
+
+  event->button = atoi(button);
+
+  return event->name[0] != '\0';
+}
+
+/*
+ * Read whatever click events are pending on `fd` and hand every complete one
+ * to `handler`. Returns 0 once the bar has closed our stdin.
+ */
+int8_t i3bar_read_clicks(int fd, void (*handler)(const struct click_event *)) {
+  static char buffer[I3BAR_CLICK_BUFFER_LEN];
+  static size_t filled = 0;
+  struct click_event event;
+  ssize_t count;
+  char *line, *newline;
+
+  if ((count = read(fd, buffer + filled, sizeof(buffer) - filled - 1)) <= 0) {
+    if (count == -1 && (errno == EINTR || errno == EAGAIN)) {
+      return 1;
+    }
+    return 0;
+  }
+
+  filled += count;
+  buffer[filled] = '\0';
+
+  line = buffer;
+  while ((newline = strchr(line, '\n')) != NULL) {
+    *newline = '\0';
+
+    /* Events arrive as an infinite array: "[", "{...}", ",{...}", ... */
+    while (*line == '[' || *line == ',' || *line == ' ') {
+      line++;
+    }
+
+    if (*line == '{' && i3bar_parse_click(line, &event)) {
+      handler(&event);
+    }
+
+    line = newline + 1;
+  }
+
+  filled -= line - buffer;
+  memmove(buffer, line, filled);
+
+  /* A line longer than the whole buffer can never be parsed, drop it */
+  if (filled == sizeof(buffer) - 1) {
+    filled = 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,32 @@
+#ifndef I3BAR_H
+#define I3BAR_H
+
+#include "block.h"
+#include "json.h"
+
+#define I3BAR_HEADER "{\"version\":1,\"click_events\":true}\n[\n[]\n"
+#define I3BAR_CLICK_BUFFER_LEN 4096
+#define I3BAR_NAME_LEN 32
+
+enum ClickButton {
+  BTN_LEFT = 1,
+  BTN_MIDDLE = 2,
+  BTN_RIGHT = 3,
+  BTN_SCROLL_UP = 4,
+  BTN_SCROLL_DOWN = 5
+};
+
+struct click_event {
+  char name[I3BAR_NAME_LEN];
+  char instance[BLOCK_INSTANCE_LEN];
+  int button;
+};
+
+void i3bar_begin_frame(struct json_writer *writer);
+void i3bar_block(struct json_writer *writer, const char *name,
+                 const struct block *block);
+void i3bar_end_frame(struct json_writer *writer);
+int8_t i3bar_parse_click(const char *line, struct click_event *event);
+int8_t i3bar_read_clicks(int fd, void (*handler)(const struct click_event *));
+
+#endif // I3BAR_H
@@ -0,0 +1,151 @@
+#include "json.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+void json_init(struct json_writer *writer, char *buf, size_t size) {
+  writer->buf = buf;
+  writer->len = 0;
+  writer->size = size;
+  writer->depth = 0;
+  writer->overflow = 0;
+  writer->after_key = 0;
+  writer->has_items[0] = 0;
+}
+
+void json_raw(struct json_writer *writer, const char *text, size_t len) {
+  if (writer->overflow || writer->len + len > writer->size) {
+    writer->overflow = 1;
+    return;
+  }
+
+  memcpy(writer->buf + writer->len, text, len);
+  writer->len += len;
+}
+
+static void json_char(struct json_writer *writer, char c) {
+  json_raw(writer, &c, 1);
+}
+
+/* Emit the separator owed before a new value at the current depth */
+static void json_separate(struct json_writer *writer) {
+  if (writer->after_key) {
+    writer->after_key = 0;
+    return;
+  }
+
+  if (writer->has_items[writer->depth]) {
+    json_char(writer, ',');
+  }
+  writer->has_items[writer->depth] = 1;
+}
+
+static void json_open(struct json_writer *writer, char c) {
+  json_separate(writer);
+  json_char(writer, c);
+
+  if (writer->depth + 1 >= JSON_MAX_DEPTH) {
+    writer->overflow = 1;
+    return;
+  }
+
+  writer->has_items[++writer->depth] = 0;
+}
+
+static void json_close(struct json_writer *writer, char c) {
+  if (writer->depth > 0) {
+    writer->depth--;
+  }
+  json_char(writer, c);
+}
+
+void json_begin_object(struct json_writer *writer) { json_open(writer, '{'); }
+
+void json_end_object(struct json_writer *writer) { json_close(writer, '}'); }
+
+void json_begin_array(struct json_writer *writer) { json_open(writer, '['); }
+
+void json_end_array(struct json_writer *writer) { json_close(writer, ']'); }
+
+static void json_quoted(struct json_writer *writer, const char *value) {
+  static const char hex[] = "0123456789abcdef";
+  const char *run = value;
+
+  json_char(writer, '"');
+
+  /* Copy unescaped runs in one go, only breaking out for special bytes */
+  for (; *value; value++) {
+    unsigned char c = (unsigned char)*value;
+    char escape[6] = {'\\', 'u', '0', '0', 0, 0};
+
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+
+    json_raw(writer, run, value - run);
+    run = value + 1;
+
+    switch (c) {
+    case '"':
+    case '\\':
+      escape[1] = c;
+      json_raw(writer, escape, 2);
+      break;
+    case '\n':
+      json_raw(writer, "\\n", 2);
+      break;
+    case '\t':
+      json_raw(writer, "\\t", 2);
+      break;
+    default:
+      escape[4] = hex[c >> 4];
+      escape[5] = hex[c & 0xf];
+      json_raw(writer, escape, 6);
+      break;
+    }
+  }
+
+  json_raw(writer, run, value - run);
+  json_char(writer, '"');
+}
+
+void json_key(struct json_writer *writer, const char *key) {
+  json_separate(writer);
+  json_quoted(writer, key);
+  json_char(writer, ':');
+  writer->after_key = 1;
+}
+
+void json_string(struct json_writer *writer, const char *value) {
+  json_separate(writer);
+  json_quoted(writer, value);
+}
+
+void json_int(struct json_writer *writer, long value) {
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  unsigned long magnitude =
+      value < 0 ? -(unsigned long)value : (unsigned long)value;
+
+  do {
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+
+  if (value < 0) {
+    *--p = '-';
+  }
+
+  json_separate(writer);
+  json_raw(writer, p, digits + sizeof(digits) - p);
+}
+
+void json_bool(struct json_writer *writer, int value) {
+  json_separate(writer);
+  if (value) {
+    json_raw(writer, "true", 4);
+  } else {
+    json_raw(writer, "false", 5);
+  }
+}
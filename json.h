@@ -0,0 +1,35 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_MAX_DEPTH 8
+
+/*
+ * Streaming JSON encoder writing straight into a caller owned buffer. Nothing
+ * is allocated; once the buffer is full further output is dropped and
+ * `overflow` is set so the caller can discard the frame.
+ */
+struct json_writer {
+  char *buf;
+  size_t len;
+  size_t size;
+  uint8_t depth;
+  uint8_t overflow;
+  uint8_t after_key;
+  uint8_t has_items[JSON_MAX_DEPTH];
+};
+
+void json_init(struct json_writer *writer, char *buf, size_t size);
+void json_raw(struct json_writer *writer, const char *text, size_t len);
+void json_begin_object(struct json_writer *writer);
+void json_end_object(struct json_writer *writer);
+void json_begin_array(struct json_writer *writer);
+void json_end_array(struct json_writer *writer);
+void json_key(struct json_writer *writer, const char *key);
+void json_string(struct json_writer *writer, const char *value);
+void json_int(struct json_writer *writer, long value);
+void json_bool(struct json_writer *writer, int value);
+
+#endif // JSON_H
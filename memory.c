@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "memory.h"
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+struct meminfo_key {
+  const char *name;
+  size_t len;
+};
+
+#define MEMINFO_KEY(name) {name, sizeof(name) - 1}
+
+static const struct meminfo_key keys[MEM_FIELD_COUNT] = {
+    [MEM_TOTAL] = MEMINFO_KEY("MemTotal:"),
+    [MEM_AVAILABLE] = MEMINFO_KEY("MemAvailable:"),
+    [MEM_SWAP_TOTAL] = MEMINFO_KEY("SwapTotal:"),
+    [MEM_SWAP_FREE] = MEMINFO_KEY("SwapFree:"),
+    [MEM_ZSWAP] = MEMINFO_KEY("Zswap:"),
+};
+
+static int meminfo_fd = -1;
+static char meminfo[MEMINFO_BUFFER_LEN];
+static size_t read_len = sizeof(meminfo) - 1;
+
+/* Where each line started last time, -1 if this kernel does not have it */
+static int16_t offsets[MEM_FIELD_COUNT];
+static int8_t offsets_known = 0;
+
+static uint64_t values[MEM_FIELD_COUNT]; // kB
+
+/* Value of the line starting at `line` with a `key_len` long key */
+static uint64_t parse_value(const char *line, size_t key_len) {
+  const char *p = line + key_len;
+  uint64_t value = 0;
+
+  while (*p == ' ') {
+    p++;
+  }
+
+  while ((unsigned)(*p - '0') < 10) {
+    value = value * 10 + (*p++ - '0');
+  }
+
+  return value;
+}
+
+/* Walk every line, learning the offsets and how much of the file we need */
+static void scan(size_t len) {
+  const char *line = meminfo, *end;
+  size_t last_end = 0;
+  int i;
+
+  for (i = 0; i < MEM_FIELD_COUNT; i++) {
+    offsets[i] = -1;
+    values[i] = 0;
+  }
+
+  while (line < meminfo + len) {
+    if ((end = memchr(line, '\n', meminfo + len - line)) == NULL) {
+      break;
+    }
+
+    for (i = 0; i < MEM_FIELD_COUNT; i++) {
+      if (offsets[i] == -1 && strncmp(line, keys[i].name, keys[i].len) == 0) {
+        offsets[i] = line - meminfo;
+        values[i] = parse_value(line, keys[i].len);
+        last_end = end + 1 - meminfo;
+        break;
+      }
+    }
+
+    line = end + 1;
+  }
+
+  read_len = last_end + MEMINFO_SLACK;
+  if (read_len > sizeof(meminfo) - 1) {
+    read_len = sizeof(meminfo) - 1;
+  }
+  offsets_known = 1;
+}
+
+static ssize_t read_meminfo(size_t len) {
+  ssize_t count;
+
+  if ((count = replay_pread(meminfo_fd, meminfo, len)) < 0) {
+    return -1;
+  }
+
+  meminfo[count] = '\0';
+  return count;
+}
+
+/*
+ * The line order of /proc/meminfo is fixed for a running kernel, so after
+ * one full scan a sample is a single short pread() plus a key check and a
+ * number parse at each remembered offset. A key that moved (a value grew a
+ * digit) sends us back to the full scan.
+ */
+int8_t memory_sample(void) {
+  ssize_t count;
+  int i;
+
+  if (meminfo_fd == -1 && (meminfo_fd = replay_open(
+                              PROC_MEMINFO_FILE, O_RDONLY | O_CLOEXEC)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  if ((count = read_meminfo(offsets_known ? read_len : sizeof(meminfo) - 1)) <
+      0) {
+    return 0;
+  }
+
+  if (offsets_known) {
+    for (i = 0; i < MEM_FIELD_COUNT; i++) {
+      const char *line = meminfo + offsets[i];
+
+      if (offsets[i] == -1) {
+        continue;
+      }
+
+      /* The whole line has to be there, not just the key */
+      if (offsets[i] + keys[i].len > (size_t)count ||
+          memcmp(line, keys[i].name, keys[i].len) != 0 ||
+          !memchr(line, '\n', count - offsets[i])) {
+        break;
+      }
+
+      values[i] = parse_value(line, keys[i].len);
+    }
+
+    if (i == MEM_FIELD_COUNT) {
+      return 1;
+    }
+
+    if ((count = read_meminfo(sizeof(meminfo) - 1)) < 0) {
+      return 0;
+    }
+  }
+
+  scan(count);
+
+  return 1;
+}
+
+uint64_t memory_value(enum MemInfoField field) { return values[field]; }
@@ -0,0 +1,22 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+#define PROC_MEMINFO_FILE "/proc/meminfo"
+#define MEMINFO_BUFFER_LEN 8192
+#define MEMINFO_SLACK 32 // room for values growing a few digits
+
+enum MemInfoField {
+  MEM_TOTAL,
+  MEM_AVAILABLE,
+  MEM_SWAP_TOTAL,
+  MEM_SWAP_FREE,
+  MEM_ZSWAP,
+  MEM_FIELD_COUNT
+};
+
+int8_t memory_sample(void);
+uint64_t memory_value(enum MemInfoField field);
+
+#endif // MEMORY_H
@@ -1,253 +1,500 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "arena.h"
 #include "network.h"
+#include "rate.h"
+#include "replay.h"
+#include "sysfs.h"
+#include "trace.h"
+#include "wifi.h"
 
-#include <dirent.h>
 #include <errno.h>
-#include <ifaddrs.h>
-#include <limits.h>
-#include <linux/if.h>
-#include <linux/limits.h>
-#include <linux/wireless.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/socket.h>
-#include <unistd.h>
 
-char interface_name[IFALIASZ];
+/*
+ * Every interface is sampled from one read of /proc/net/dev, which lists
+ * them in the same order each time. Like disk slots, an interface is known
+ * by its line, and a name that no longer matches its line means interfaces
+ * came or went, so they are looked up and classified again. Only the
+ * selected ones have their operstate kept open.
+ */
+
+struct net_interface {
+  char name[NET_NAME_LEN];
+  uint8_t net_class; // NET_CLASSES for loopback, which is never counted
+  uint8_t selected;
+  int operstate_fd;
+  uint64_t down_bytes;
+  uint64_t up_bytes;
+};
+
+static char selection[NET_SELECTION_LEN];
+static const char *selectors[NET_MAX_SELECTORS];
+static uint8_t selector_count = 0;
+
+static int net_dev_fd = -1;
+static char *net_dev;
+
+static struct net_interface *interfaces;
+static uint8_t interface_count = 0;
+static int8_t discovered = 0;
+
+/* Rates over the selected interfaces, in total and per class */
+static struct rate_history down_rates, up_rates, total_rates;
+static struct rate_history class_down_rates[NET_CLASSES];
+static struct rate_history class_up_rates[NET_CLASSES];
+static uint8_t class_connected[NET_CLASSES];
+static const char *wireless_up = NULL; // first selected Wi-Fi that is up
+static int64_t sampled_at;
+
+/* -----RFKILL----- */
+
+static int8_t match_wlan(const char *name, void *rfkill_device) {
+  if (is_device_wlan(name)) {
+    strncpy(rfkill_device, name, RFKILL_DEV_NAME_LEN - 1);
+    ((char *)rfkill_device)[RFKILL_DEV_NAME_LEN - 1] = '\0';
+    return 1;
+  }
+
+  return 0;
+}
 
+/* Leaves rfkill_device empty on machines without a wlan kill switch */
 void find_rfkill_device(char *rfkill_device) {
 
-  DIR *dirp;
-  struct dirent *dir = NULL;
-  char rfkill_device_dir_path[PATH_MAX];
+  rfkill_device[0] = '\0';
+  sysfs_scan_dir(RFKILL_DIR, match_wlan, rfkill_device);
+}
+
+int8_t is_device_wlan(const char *rfkill_device) {
+
+  char rfkill_dev_type[SYSFS_VALUE_LEN];
 
-  if ((dirp = opendir(RFKILL_DIR)) == NULL) {
-    perror("opendir() failed!");
-    exit(1);
+  if (!sysfs_read(RFKILL_DIR, rfkill_device, RFKILL_DEV_TYPE_FILE,
+                  rfkill_dev_type, sizeof(rfkill_dev_type))) {
+    return 0;
   }
 
-  while (1) { // loop through files in RFKILL_DIR
+  if (!(strncmp(rfkill_dev_type, RFKILL_DEV_WLAN,
+                strlen(RFKILL_DEV_WLAN) + 1))) { // found wlan device
+    return 1;
+  }
 
-    strncpy(rfkill_device_dir_path, RFKILL_DIR, strlen(RFKILL_DIR) + 1);
+  return 0;
+}
 
-    if ((dir = readdir(dirp)) == NULL) {
-      if (errno) {
-        perror("readdir() failed!");
-        exit(1);
-      } else {
-        break;
-      }
-    } else {
-      if (dir->d_name[0] == '.') { // skip . and ..
-        continue;
-      } else {
-        strncat(rfkill_device_dir_path, "/", 2);
-        strncat(rfkill_device_dir_path, dir->d_name, strlen(dir->d_name) + 1);
-
-        if (is_device_wlan(rfkill_device_dir_path)) {
-          strncpy(rfkill_device, dir->d_name, strlen(dir->d_name) + 1);
-          break;
-        } else {
-          continue;
-        }
-      }
-    }
+int8_t network_is_enabled(char *rfkill_device) {
+
+  char state[SYSFS_VALUE_LEN];
+
+  if (rfkill_device[0] == '\0') { // nothing can block the network
+    return 1;
   }
 
-  if ((closedir(dirp)) == -1) {
-    perror("closedir() failed!");
-    exit(1);
+  if (!sysfs_read(RFKILL_DIR, rfkill_device, RFKILL_DEV_STATE_FILE, state,
+                  sizeof(state))) {
+    return 1;
+  }
+
+  return (int8_t)atoi(state);
+}
+
+/* Asked once per interface, when interfaces are looked up */
+int8_t interface_is_wireless(const char *device) {
+  char key[REPLAY_KEY_LEN];
+  uint32_t since = replay_calls();
+  size_t len;
+  int wireless;
+
+  snprintf(key, sizeof(key), "wireless %s", device);
+  if (replay_next(REPLAY_VALUE, key, &len, &wireless) != NULL) {
+    return wireless;
   }
+
+  wireless = wifi_is_wireless(device);
+  replay_capture(REPLAY_VALUE, key, NULL, 0, wireless, since);
+
+  return wireless;
 }
 
-int8_t is_device_wlan(char *rfkill_device_dir_path) {
+/* -----SELECTION----- */
+
+/*
+ * Comma separated name patterns, e.g. "eth*,wlan0"; a leading '!' excludes
+ * instead. Without any including pattern every interface but the virtual
+ * ones is counted.
+ */
+void network_select(const char *patterns) {
+  char *pattern;
 
-  FILE *fp;
-  char rfkill_dev_type[PATH_MAX];
+  strncpy(selection, patterns, sizeof(selection) - 1);
+  pattern = strtok(selection, ",");
 
-  strncat(rfkill_device_dir_path, RFKILL_DEV_TYPE_FILE,
-          strlen(RFKILL_DEV_TYPE_FILE) + 1);
+  selector_count = 0;
 
-  if ((fp = fopen(rfkill_device_dir_path, "r")) == NULL) {
-    perror("fopen() error!");
-    exit(1);
+  while (pattern && selector_count < NET_MAX_SELECTORS) {
+    selectors[selector_count++] = pattern;
+    pattern = strtok(NULL, ",");
   }
+}
+
+/* Look the interfaces up again on the next sample */
+void network_invalidate(void) { discovered = 0; }
 
-  fscanf(fp, "%s", rfkill_dev_type);
+static int8_t is_selected(const char *name, uint8_t net_class) {
+  int8_t included = 0, has_includes = 0;
+  size_t i;
 
-  if ((fclose(fp)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
+  if (net_class == NET_CLASSES) {
+    return 0;
   }
 
-  if (!(strncmp(rfkill_dev_type, RFKILL_DEV_WLAN,
-                strlen(RFKILL_DEV_WLAN) + 1))) { // found wlan device
-    return 1;
+  for (i = 0; i < selector_count; i++) {
+    if (selectors[i][0] == '!') {
+      if (fnmatch(selectors[i] + 1, name, 0) == 0) {
+        return 0;
+      }
+    } else {
+      has_includes = 1;
+      included |= fnmatch(selectors[i], name, 0) == 0;
+    }
   }
 
-  return 0;
+  return has_includes ? included : net_class != NET_VIRTUAL;
 }
 
-int8_t network_is_enabled(char *rfkill_device) {
+/* -----DISCOVERY----- */
+
+static int8_t has_file(const char *name, const char *file) {
+  int fd;
+
+  if ((fd = sysfs_open(NET_DEVICES_DIR, name, file)) == -1) {
+    return 0;
+  }
+
+  replay_close(fd);
+  return 1;
+}
+
+/*
+ * Wi-Fi is what nl80211 knows; tun, tap, WireGuard and PPP are not
+ * plain Ethernet or have tun flags; what is left is hardware when it has a
+ * device behind it (USB tethering included) and virtual otherwise (veth,
+ * bridges, docker0).
+ */
+static uint8_t classify(const char *name) {
+  int64_t type = NET_DEVICE_TYPE_ETHER;
+  int fd;
+
+  if ((fd = sysfs_open(NET_DEVICES_DIR, name, NET_DEVICE_TYPE_FILE)) >= 0) {
+    sysfs_pread_int(fd, &type);
+    replay_close(fd);
+  }
+
+  if (type == NET_DEVICE_TYPE_LOOPBACK) {
+    return NET_CLASSES;
+  }
+  if (interface_is_wireless(name)) {
+    return NET_WIRELESS;
+  }
+  if (type != NET_DEVICE_TYPE_ETHER || has_file(name, NET_DEVICE_TUN_FILE)) {
+    return NET_TUNNEL;
+  }
+  if (!has_file(name, NET_DEVICE_LINK_FILE)) {
+    return NET_VIRTUAL;
+  }
 
-  FILE *fp;
-  int8_t state = 0;
-  char rfkill_dev_path[PATH_MAX];
+  return NET_WIRED;
+}
 
-  strncpy(rfkill_dev_path, RFKILL_DIR, strlen(RFKILL_DIR) + 1);
-  strncat(rfkill_dev_path, "/", 2);
-  strncat(rfkill_dev_path, rfkill_device, strlen(rfkill_device) + 1);
-  strncat(rfkill_dev_path, RFKILL_DEV_STATE_FILE,
-          strlen(RFKILL_DEV_STATE_FILE) + 1);
+static int8_t net_dev_open(void) {
+  if (net_dev_fd >= 0) {
+    return 1;
+  }
 
-  if ((fp = fopen(rfkill_dev_path, "r")) == NULL) {
-    perror("fopen() error!");
-    exit(1);
+  if ((net_dev_fd = replay_open(PROC_NET_DEV_FILE, O_RDONLY | O_CLOEXEC)) ==
+      -1) {
+    perror("open() failed!");
+    return 0;
   }
 
-  fscanf(fp, "%hhd", &state);
+  net_dev = arena_alloc(NET_DEV_BUFFER_LEN);
+  interfaces = arena_alloc(NET_MAX_INTERFACES * sizeof(*interfaces));
+
+  return 1;
+}
+
+static const char *parse_u64(const char *p, uint64_t *value) {
+  uint64_t v = 0;
+
+  while (*p == ' ') {
+    p++;
+  }
 
-  if ((fclose(fp)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
+  while ((unsigned)(*p - '0') < 10) {
+    v = v * 10 + (*p++ - '0');
   }
 
-  return (state);
+  *value = v;
+  return p;
 }
 
-int8_t network_is_connected(void) {
+/*
+ * Name and byte counters of the line at `p`, e.g.
+ * "  eth0: 1234 5 0 0 0 0 0 0 5678 ...". Returns the next line, or NULL
+ * when there is none.
+ */
+static const char *parse_line(const char *p, const char *end, char *name,
+                              uint64_t *down_bytes, uint64_t *up_bytes) {
+  const char *line_end, *colon;
+  uint64_t ignored;
+  size_t len;
+  int i;
+
+  if ((line_end = memchr(p, '\n', end - p)) == NULL) {
+    return NULL;
+  }
 
-  FILE *fp;
-  char dev_state[NET_DEVICE_STATE_LEN];
-  char rfkill_dev_state_path[PATH_MAX];
+  while (*p == ' ') {
+    p++;
+  }
 
-  get_wireless_network_interface_name();
+  if ((colon = memchr(p, ':', line_end - p)) == NULL) {
+    return NULL;
+  }
 
-  strncpy(rfkill_dev_state_path, NET_DEVICES_DIR, strlen(NET_DEVICES_DIR) + 1);
-  strncat(rfkill_dev_state_path, interface_name, strlen(interface_name) + 1);
-  strncat(rfkill_dev_state_path, NET_DEVICE_STATE_FILE,
-          strlen(NET_DEVICE_STATE_FILE) + 1);
+  len = colon - p < NET_NAME_LEN ? (size_t)(colon - p) : NET_NAME_LEN - 1;
+  memcpy(name, p, len);
+  name[len] = '\0';
 
-  if ((fp = fopen(rfkill_dev_state_path, "r")) == NULL) {
-    perror("fopen() error!");
-    exit(1);
+  p = parse_u64(colon + 1, down_bytes);
+  for (i = 0; i < 7; i++) {
+    p = parse_u64(p, &ignored); // packets, errors, ... multicast
   }
+  parse_u64(p, up_bytes);
+
+  return line_end + 1;
+}
 
-  fscanf(fp, "%s", dev_state);
+/* The first line of interfaces, past the two header lines */
+static const char *first_line(const char *p, const char *end) {
+  int i;
 
-  if ((fclose(fp)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
+  for (i = 0; i < 2 && p != NULL; i++) {
+    if ((p = memchr(p, '\n', end - p)) != NULL) {
+      p++;
+    }
   }
 
-  if (!strncmp(dev_state, NET_DEVICE_STATE_UP, NET_DEVICE_STATE_LEN))
-    return 1;
+  return p;
+}
 
-  return 0;
+static void clear_up(void) {
+  memset(class_connected, 0, sizeof(class_connected));
+  wireless_up = NULL;
 }
 
-void get_wireless_network_interface_name(void) {
+static void mark_up(const struct net_interface *interface) {
+  class_connected[interface->net_class] = 1;
+
+  if (interface->net_class == NET_WIRELESS && wireless_up == NULL) {
+    wireless_up = interface->name;
+  }
+}
 
-  struct ifaddrs *ifa;
+static int8_t is_up(int operstate_fd) {
+  char state[SYSFS_VALUE_LEN];
 
-  if (getifaddrs(&ifa) == -1) {
-    perror("getifaddrs() failed!");
-    exit(1);
+  if (!sysfs_pread(operstate_fd, state, sizeof(state))) {
+    return 0;
   }
 
-  while (ifa->ifa_next != NULL) {
-    if (interface_is_wireless(ifa->ifa_name)) {
-      strncpy(interface_name, ifa->ifa_name, IFNAMSIZ);
-      return;
+  return strcmp(state, NET_DEVICE_STATE_UP) == 0 ||
+         strcmp(state, NET_DEVICE_STATE_UNKNOWN) == 0;
+}
+
+static void close_interfaces(void) {
+  uint8_t i;
+
+  for (i = 0; i < interface_count; i++) {
+    if (interfaces[i].operstate_fd >= 0) {
+      replay_close(interfaces[i].operstate_fd);
+    }
+  }
+
+  interface_count = 0;
+}
+
+static void discover(const char *p, const char *end) {
+  struct net_interface *interface;
+
+  close_interfaces();
+  clear_up();
+
+  while (p != NULL && interface_count < NET_MAX_INTERFACES) {
+    interface = &interfaces[interface_count];
+    if ((p = parse_line(p, end, interface->name, &interface->down_bytes,
+                        &interface->up_bytes)) == NULL) {
+      break;
     }
 
-    ifa = ifa->ifa_next;
+    interface->net_class = classify(interface->name);
+    interface->selected = is_selected(interface->name, interface->net_class);
+    interface->operstate_fd =
+        interface->selected ? sysfs_open(NET_DEVICES_DIR, interface->name,
+                                         NET_DEVICE_STATE_FILE)
+                            : -1;
+
+    if (interface->selected && is_up(interface->operstate_fd)) {
+      mark_up(interface);
+    }
+    interface_count++;
   }
 
-  fprintf(stderr, "no wireless interfaces!\n");
-  exit(1);
+  discovered = 1;
 }
 
+/* -----SAMPLING----- */
+
 /*
- * This is a pretty neat hack by a guy named "Edu Felipe" to check if an
- * interface is wireless. Check it out at
- * https://gist.github.com/edufelipe/6108057
+ * Walk the lines against the known interfaces and add up the traffic of the
+ * selected ones by class. Returns 0 when the interfaces changed.
  */
+static int8_t collect(const char *p, const char *end,
+                      uint64_t down_delta[NET_CLASSES],
+                      uint64_t up_delta[NET_CLASSES]) {
+  struct net_interface *interface;
+  uint64_t down_bytes, up_bytes;
+  char name[NET_NAME_LEN];
+  uint8_t i;
+
+  for (i = 0; i < interface_count; i++) {
+    interface = &interfaces[i];
+
+    if (p == NULL ||
+        (p = parse_line(p, end, name, &down_bytes, &up_bytes)) == NULL ||
+        strcmp(name, interface->name) != 0) {
+      return 0;
+    }
 
-int8_t interface_is_wireless(const char *device) {
-
-  int sock = -1;
-  struct iwreq iw;
-  char protocol[IFNAMSIZ];
+    /* Counters go back to zero when a driver is reloaded */
+    if (interface->selected && down_bytes >= interface->down_bytes &&
+        up_bytes >= interface->up_bytes) {
+      down_delta[interface->net_class] += down_bytes - interface->down_bytes;
+      up_delta[interface->net_class] += up_bytes - interface->up_bytes;
+    }
 
-  memset(&iw, 0, sizeof(iw));
-  strncpy(iw.ifr_name, device, IFNAMSIZ);
+    interface->down_bytes = down_bytes;
+    interface->up_bytes = up_bytes;
 
-  if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-    perror("socket() failed!");
-    exit(1);
+    if (interface->selected && is_up(interface->operstate_fd)) {
+      mark_up(interface);
+    }
   }
 
-  if (ioctl(sock, SIOCGIWNAME, &iw) != -1) {
-    strcpy(protocol, iw.u.name);
-    close(sock);
-    return 1;
+  /* A line past the known ones is a new interface */
+  return p == NULL || memchr(p, ':', end - p) == NULL;
+}
+
+static void push_rates(const uint64_t down_delta[NET_CLASSES],
+                       const uint64_t up_delta[NET_CLASSES], int64_t elapsed) {
+  uint64_t down_rate, up_rate, down_total = 0, up_total = 0;
+  uint8_t c;
+
+  for (c = 0; c < NET_CLASSES; c++) {
+    down_rate = down_delta[c] * 1000 / elapsed;
+    up_rate = up_delta[c] * 1000 / elapsed;
+    rate_push(&class_down_rates[c], down_rate);
+    rate_push(&class_up_rates[c], up_rate);
+    down_total += down_rate;
+    up_total += up_rate;
   }
 
-  close(sock);
-  return 0;
+  rate_push(&down_rates, down_total);
+  rate_push(&up_rates, up_total);
+  rate_push(&total_rates, down_total + up_total);
 }
 
-void get_bytes_transferred(float *down_bytes, float *up_bytes) {
-
-  FILE *up_bytes_file, *down_bytes_file;
-  uint64_t bytes_sent, bytes_sent_after_interval, bytes_received,
-      bytes_received_after_interval;
-  char up_path[PATH_MAX], down_path[PATH_MAX];
+/*
+ * Read the counters of every interface in one go and push the rates since
+ * the last sample. A sample that finds the interfaces changed only starts
+ * over from the new set.
+ */
+int8_t network_sample(void) {
+  uint64_t down_delta[NET_CLASSES] = {0}, up_delta[NET_CLASSES] = {0};
+  const char *end;
+  int64_t now, elapsed;
+  ssize_t count;
+
+  if (!net_dev_open()) {
+    return 0;
+  }
 
-  strncpy(up_path, NET_DEVICES_DIR, strlen(NET_DEVICES_DIR) + 1);
-  strncat(up_path, interface_name, strlen(interface_name) + 1);
+  trace_begin("network_sample");
+  count = replay_pread(net_dev_fd, net_dev, NET_DEV_BUFFER_LEN - 1);
+  trace_end("network_sample");
 
-  strncpy(down_path, up_path, strlen(up_path) + 1);
+  if (count < 0) {
+    return 0;
+  }
 
-  strncat(down_path, NET_DEVICE_DOWN_BYTES_FILE,
-          strlen(NET_DEVICE_DOWN_BYTES_FILE) + 1);
-  strncat(up_path, NET_DEVICE_UP_BYTES_FILE,
-          strlen(NET_DEVICE_UP_BYTES_FILE) + 1);
+  net_dev[count] = '\0';
+  end = net_dev + count;
+  now = replay_clock_ms();
+  clear_up();
 
-  if ((down_bytes_file = fopen(down_path, "r")) == NULL) {
-    perror("fopen() failed!");
-    exit(1);
+  if (!discovered || !collect(first_line(net_dev, end), end, down_delta,
+                              up_delta)) {
+    discover(first_line(net_dev, end), end);
+  } else if ((elapsed = now - sampled_at) > 0) {
+    push_rates(down_delta, up_delta, elapsed);
   }
 
-  if ((up_bytes_file = fopen(up_path, "r")) == NULL) {
-    perror("fopen() failed!");
-    exit(1);
+  sampled_at = now;
+  return 1;
+}
+
+/* -----RESULTS----- */
+
+/* Whether a selected interface of the class is up */
+int8_t network_connected(enum NetClass net_class) {
+  return class_connected[net_class];
+}
+
+/* Name of the Wi-Fi interface in use, NULL when none is up */
+const char *network_wireless_interface(void) { return wireless_up; }
+
+int8_t network_any_connected(void) {
+  uint8_t c;
+
+  for (c = 0; c < NET_CLASSES; c++) {
+    if (class_connected[c]) {
+      return 1;
+    }
   }
 
-  fscanf(down_bytes_file, "%ld", &bytes_received);
-  fscanf(up_bytes_file, "%ld", &bytes_sent);
+  return 0;
+}
 
-  usleep(WAIT_TIME_MICROSECONDS);
+/* Whether two samples were taken, so there are rates to show at all */
+int8_t network_has_rates(void) { return rate_samples(&total_rates) > 0; }
 
-  rewind(down_bytes_file);
-  rewind(up_bytes_file);
+/* Rates of the selected interfaces, in bytes per second */
+const struct rate_history *network_down_rates(void) { return &down_rates; }
 
-  fscanf(down_bytes_file, "%ld", &bytes_received_after_interval);
-  fscanf(up_bytes_file, "%ld", &bytes_sent_after_interval);
+const struct rate_history *network_up_rates(void) { return &up_rates; }
 
-  *down_bytes = (bytes_received_after_interval - bytes_received) / 512.0;
-  *up_bytes = (bytes_sent_after_interval - bytes_sent) / 512.0;
+const struct rate_history *network_total_rates(void) { return &total_rates; }
 
-  if ((fclose(down_bytes_file)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
-  }
+const struct rate_history *network_class_down_rates(enum NetClass net_class) {
+  return &class_down_rates[net_class];
+}
 
-  if ((fclose(up_bytes_file)) == EOF) {
-    perror("fclose() error!");
-    exit(1);
-  }
+const struct rate_history *network_class_up_rates(enum NetClass net_class) {
+  return &class_up_rates[net_class];
 }
@@ -3,28 +3,50 @@
 
 #include <stdint.h>
 
+#include "rate.h"
+
 #define RFKILL_DIR "/sys/class/rfkill/"
 #define RFKILL_DEV_TYPE_FILE "/type"
 #define RFKILL_DEV_STATE_FILE "/state"
 #define RFKILL_DEV_WLAN "wlan"
 
+#define PROC_NET_DEV_FILE "/proc/net/dev"
 #define NET_DEVICES_DIR "/sys/class/net/"
 #define NET_DEVICE_STATE_FILE "/operstate"
+#define NET_DEVICE_TYPE_FILE "/type"
+#define NET_DEVICE_LINK_FILE "/device" // only hardware has one
+#define NET_DEVICE_TUN_FILE "/tun_flags"
 #define NET_DEVICE_STATE_UP "up"
-#define NET_DEVICE_STATE_LEN 5
-#define NET_DEVICE_UP_BYTES_FILE "/statistics/tx_bytes"
-#define NET_DEVICE_DOWN_BYTES_FILE "/statistics/rx_bytes"
+#define NET_DEVICE_STATE_UNKNOWN "unknown" // tun and WireGuard never say up
+#define NET_DEVICE_TYPE_ETHER 1
+#define NET_DEVICE_TYPE_LOOPBACK 772
+
+#define RFKILL_DEV_NAME_LEN 10
 
-#define WAIT_TIME_MICROSECONDS 500000 // 0.5 seconds
+#define NET_MAX_INTERFACES 64
+#define NET_MAX_SELECTORS 8
+#define NET_SELECTION_LEN 256
+#define NET_NAME_LEN 16 // IFNAMSIZ
+#define NET_DEV_BUFFER_LEN (16 * 1024)
 
-extern int usleep (__useconds_t __useconds); // to shut up the compiler
+enum NetClass { NET_WIRED, NET_WIRELESS, NET_TUNNEL, NET_VIRTUAL, NET_CLASSES };
 
 void find_rfkill_device(char *rfkill_device);
-int8_t is_device_wlan(char *rfkill_device_dir_path);
+int8_t is_device_wlan(const char *rfkill_device);
 int8_t network_is_enabled(char *rfkill_device);
-int8_t network_is_connected(void);
-void get_wireless_network_interface_name(void);
 int8_t interface_is_wireless(const char *device);
-void get_bytes_transferred(float *down_bytes, float *up_bytes);
+
+void network_select(const char *patterns);
+void network_invalidate(void);
+int8_t network_sample(void);
+int8_t network_connected(enum NetClass net_class);
+int8_t network_any_connected(void);
+int8_t network_has_rates(void);
+const char *network_wireless_interface(void);
+const struct rate_history *network_down_rates(void);
+const struct rate_history *network_up_rates(void);
+const struct rate_history *network_total_rates(void);
+const struct rate_history *network_class_down_rates(enum NetClass net_class);
+const struct rate_history *network_class_up_rates(enum NetClass net_class);
 
 #endif // NETWORK_H
@@ -0,0 +1,268 @@
+#define _DEFAULT_SOURCE
+
+#include "power.h"
+#include "battery.h"
+#include "replay.h"
+
+#include <dbus/dbus.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+/*
+ * Let the kernel batch our timer with other wakeups. Nothing on the bar needs
+ * better than a few tens of milliseconds of precision.
+ */
+void power_set_timer_slack(void) {
+  if (prctl(PR_SET_TIMERSLACK, POWER_TIMER_SLACK_NS, 0, 0, 0) == -1) {
+    perror("prctl() failed!");
+  }
+}
+
+int8_t power_on_battery(void) {
+  char battery_name[BAT_NAME_LEN];
+  char battery_status[BAT_STATUS_LEN];
+
+  if (!get_battery_name(battery_name)) {
+    return 0; // desktops are always on AC
+  }
+
+  get_battery_status(battery_name, battery_status);
+
+  return strncmp(battery_status, POWER_DISCHARGING_STATE, BAT_STATUS_LEN) == 0;
+}
+
+/* -----SESSION----- */
+
+/*
+ * logind's LockedHint and IdleHint of our session, read once and then kept
+ * up to date from its PropertiesChanged signals, so rescheduling never waits
+ * on the bus. The signals come from the real object path of the session, not
+ * from the "auto" alias, so that is asked for first.
+ */
+
+static DBusConnection *session_bus = NULL;
+static char session_path[POWER_SESSION_PATH_LEN] = LOGIN1_SESSION_PATH;
+static int8_t session_locked = 0;
+static int8_t session_idle = 0;
+static int8_t session_changed = 0;
+
+/* Take the hints out of an a{sv} of session properties */
+static void read_session_flags(DBusMessageIter *properties) {
+  DBusMessageIter entry, variant;
+  dbus_bool_t value;
+  const char *key;
+
+  for (; dbus_message_iter_get_arg_type(properties) == DBUS_TYPE_DICT_ENTRY;
+       dbus_message_iter_next(properties)) {
+    dbus_message_iter_recurse(properties, &entry);
+
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING) {
+      continue;
+    }
+    dbus_message_iter_get_basic(&entry, &key);
+    dbus_message_iter_next(&entry);
+
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_VARIANT) {
+      continue;
+    }
+    dbus_message_iter_recurse(&entry, &variant);
+
+    if (dbus_message_iter_get_arg_type(&variant) != DBUS_TYPE_BOOLEAN) {
+      continue;
+    }
+    dbus_message_iter_get_basic(&variant, &value);
+
+    if (strcmp(key, "LockedHint") == 0) {
+      session_changed |= session_locked != (value != 0);
+      session_locked = value != 0;
+    } else if (strcmp(key, "IdleHint") == 0) {
+      session_changed |= session_idle != (value != 0);
+      session_idle = value != 0;
+    }
+  }
+}
+
+/* The reply of a call on logind, NULL when it failed or was an error */
+static DBusMessage *call_logind(DBusConnection *conn, DBusMessage *msg) {
+  DBusError error;
+  DBusMessage *reply;
+
+  dbus_error_init(&error);
+  reply = replay_dbus_call(conn, msg, &error);
+  dbus_message_unref(msg);
+
+  if (dbus_error_is_set(&error)) {
+    dbus_error_free(&error);
+    if (reply)
+      dbus_message_unref(reply);
+    return NULL;
+  }
+
+  return reply;
+}
+
+/* Resolve the "auto" session to the object path its signals come from */
+static void find_session_path(DBusConnection *conn) {
+  const char *session = "auto", *path;
+  DBusMessage *msg, *reply;
+
+  msg = dbus_message_new_method_call(LOGIN1_BUS_NAME, LOGIN1_MANAGER_PATH,
+                                     LOGIN1_MANAGER_INTERFACE, "GetSession");
+  if (!msg) {
+    return;
+  }
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &session,
+                           DBUS_TYPE_INVALID);
+
+  if ((reply = call_logind(conn, msg)) == NULL) {
+    return;
+  }
+
+  if (dbus_message_get_args(reply, NULL, DBUS_TYPE_OBJECT_PATH, &path,
+                            DBUS_TYPE_INVALID) &&
+      strlen(path) < sizeof(session_path)) {
+    strcpy(session_path, path);
+  }
+
+  dbus_message_unref(reply);
+}
+
+static void read_session(DBusConnection *conn) {
+  const char *interface = LOGIN1_SESSION_INTERFACE;
+  DBusMessage *msg, *reply;
+  DBusMessageIter iter, properties;
+
+  msg = dbus_message_new_method_call(LOGIN1_BUS_NAME, session_path,
+                                     DBUS_INTERFACE_PROPERTIES, "GetAll");
+  if (!msg) {
+    return;
+  }
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &interface,
+                           DBUS_TYPE_INVALID);
+
+  if ((reply = call_logind(conn, msg)) == NULL) {
+    return;
+  }
+
+  if (dbus_message_iter_init(reply, &iter) &&
+      dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+    dbus_message_iter_recurse(&iter, &properties);
+    read_session_flags(&properties);
+  }
+
+  dbus_message_unref(reply);
+}
+
+/* PropertiesChanged(interface, changed a{sv}, invalidated as) */
+static DBusHandlerResult session_filter(DBusConnection *conn,
+                                        DBusMessage *msg, void *data) {
+  DBusMessageIter iter, properties;
+  const char *interface;
+
+  (void)conn; // Unused parameter
+  (void)data; // Unused parameter
+
+  if (!dbus_message_is_signal(msg, DBUS_INTERFACE_PROPERTIES,
+                              "PropertiesChanged") ||
+      !dbus_message_has_path(msg, session_path) ||
+      !dbus_message_iter_init(msg, &iter) ||
+      dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  dbus_message_iter_get_basic(&iter, &interface);
+  if (strcmp(interface, LOGIN1_SESSION_INTERFACE) == 0 &&
+      dbus_message_iter_next(&iter) &&
+      dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+    dbus_message_iter_recurse(&iter, &properties);
+    read_session_flags(&properties);
+  }
+
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/*
+ * Read the session hints and subscribe to their changes. The calls give up
+ * at the caller's deadline. Returns the system bus descriptor to poll for
+ * the signals, -1 without one (e.g. while replaying).
+ */
+int power_watch(void) {
+  char rule[POWER_MATCH_RULE_LEN];
+  DBusConnection *conn;
+  DBusError error;
+  int fd;
+
+  dbus_error_init(&error);
+  conn = replay_dbus_bus(&error);
+
+  if (dbus_error_is_set(&error) || !conn) {
+    dbus_error_free(&error);
+    return -1;
+  }
+
+  find_session_path(conn);
+  read_session(conn);
+  session_changed = 0;
+
+  if (replay_mode() == REPLAY_PLAYING) {
+    return -1;
+  }
+
+  snprintf(rule, sizeof(rule),
+           "type='signal',sender='%s',path='%s',"
+           "interface='" DBUS_INTERFACE_PROPERTIES "',"
+           "member='PropertiesChanged'",
+           LOGIN1_BUS_NAME, session_path);
+
+  /* Without an error to fill in, the match is sent without a round trip */
+  dbus_bus_add_match(conn, rule, NULL);
+  dbus_connection_flush(conn);
+
+  if (!dbus_connection_add_filter(conn, session_filter, NULL, NULL) ||
+      !dbus_connection_get_unix_fd(conn, &fd)) {
+    replay_dbus_unref(conn);
+    return -1;
+  }
+
+  session_bus = conn; // keeps the reference
+  return fd;
+}
+
+/*
+ * Handle what arrived on the bus without waiting. Returns whether the
+ * session hints changed.
+ */
+int8_t power_dispatch(void) {
+  if (session_bus == NULL) {
+    return 0;
+  }
+
+  dbus_connection_read_write(session_bus, 0);
+  while (dbus_connection_dispatch(session_bus) == DBUS_DISPATCH_DATA_REMAINS)
+    ;
+
+  if (!session_changed) {
+    return 0;
+  }
+
+  session_changed = 0;
+  return 1;
+}
+
+int8_t power_session_idle(void) { return session_locked || session_idle; }
+
+uint8_t power_interval_scale(void) {
+  uint8_t scale = 1;
+
+  if (power_on_battery()) {
+    scale *= POWER_BATTERY_SCALE;
+  }
+
+  if (power_session_idle()) {
+    scale *= POWER_IDLE_SCALE;
+  }
+
+  return scale;
+}
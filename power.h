@@ -0,0 +1,26 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define POWER_DISCHARGING_STATE "Discharging"
+#define POWER_BATTERY_SCALE 3 // interval multiplier while on battery
+#define POWER_IDLE_SCALE 4    // further multiplier while idle or locked
+#define POWER_TIMER_SLACK_NS 50000000UL
+
+#define LOGIN1_BUS_NAME "org.freedesktop.login1"
+#define LOGIN1_SESSION_PATH "/org/freedesktop/login1/session/auto"
+#define LOGIN1_SESSION_INTERFACE "org.freedesktop.login1.Session"
+#define LOGIN1_MANAGER_PATH "/org/freedesktop/login1"
+#define LOGIN1_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define POWER_SESSION_PATH_LEN 128
+#define POWER_MATCH_RULE_LEN 512
+
+void power_set_timer_slack(void);
+int8_t power_on_battery(void);
+int power_watch(void);
+int8_t power_dispatch(void);
+int8_t power_session_idle(void);
+uint8_t power_interval_scale(void);
+
+#endif // POWER_H
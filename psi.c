@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "psi.h"
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Each /proc/pressure file is opened once with a trigger written to it. The
+ * kernel then reports POLLPRI on that descriptor when the stall threshold is
+ * crossed, so high pressure wakes the bar right away and no pressure costs
+ * nothing. The same descriptors are pread() for the averages shown in the
+ * block. Without trigger support (old kernels, or no permission) the files
+ * are still read, just without the early wakeup.
+ */
+
+static const char *psi_files[PSI_COUNT] = {
+    [PSI_CPU] = "cpu",
+    [PSI_MEMORY] = "memory",
+    [PSI_IO] = "io",
+};
+
+static int psi_fds[PSI_COUNT] = {-1, -1, -1};
+static int8_t psi_armed[PSI_COUNT];
+static time_t triggered_at[PSI_COUNT];
+static uint16_t avg10[PSI_COUNT]; // hundredths of a percent
+
+static time_t monotonic_seconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+void psi_open(void) {
+  char path[sizeof(PSI_DIR) + 8];
+  int i;
+
+  for (i = 0; i < PSI_COUNT; i++) {
+    if (psi_fds[i] >= 0) {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", PSI_DIR, psi_files[i]);
+
+    psi_fds[i] = replay_open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (psi_fds[i] >= 0) {
+      psi_armed[i] = write(psi_fds[i], PSI_TRIGGER, sizeof(PSI_TRIGGER)) > 0;
+      if (psi_armed[i]) {
+        continue;
+      }
+      replay_close(psi_fds[i]);
+    }
+
+    psi_fds[i] = replay_open(path, O_RDONLY | O_CLOEXEC);
+  }
+}
+
+/* Descriptor to poll for POLLPRI, -1 when no trigger could be set up */
+int psi_trigger_fd(enum PsiResource resource) {
+  return psi_armed[resource] ? psi_fds[resource] : -1;
+}
+
+void psi_triggered(enum PsiResource resource) {
+  triggered_at[resource] = monotonic_seconds();
+}
+
+/* "some avg10=2.95 ..." as 295 */
+static uint16_t parse_avg10(const char *p) {
+  uint16_t value = 0;
+
+  if ((p = strstr(p, "avg10=")) == NULL) {
+    return 0;
+  }
+
+  for (p += 6; *p != ' ' && *p != '\0'; p++) {
+    if ((unsigned)(*p - '0') < 10) {
+      value = value * 10 + (*p - '0');
+    }
+  }
+
+  return value;
+}
+
+int8_t psi_sample(void) {
+  char buffer[PSI_BUFFER_LEN];
+  int8_t found = 0;
+  ssize_t count;
+  int i;
+
+  psi_open();
+
+  for (i = 0; i < PSI_COUNT; i++) {
+    avg10[i] = 0;
+
+    if (psi_fds[i] < 0 ||
+        (count = replay_pread(psi_fds[i], buffer, sizeof(buffer) - 1)) <= 0) {
+      continue;
+    }
+    buffer[count] = '\0';
+
+    avg10[i] = parse_avg10(buffer);
+    found = 1;
+  }
+
+  return found;
+}
+
+/* Share of the last 10 s some task was stalled, in hundredths of a percent */
+uint16_t psi_avg10(enum PsiResource resource) { return avg10[resource]; }
+
+/* Whether the trigger fired within the last PSI_HOLD_SECONDS */
+int8_t psi_stalled(enum PsiResource resource) {
+  return triggered_at[resource] != 0 &&
+         monotonic_seconds() - triggered_at[resource] < PSI_HOLD_SECONDS;
+}
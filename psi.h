@@ -0,0 +1,24 @@
+#ifndef PSI_H
+#define PSI_H
+
+#include <stdint.h>
+
+#define PSI_DIR "/proc/pressure/"
+/*
+ * 15% of a 2 s window stalled. Unprivileged triggers need a window that is a
+ * multiple of 2 s, so this is the shortest one that works for everybody.
+ */
+#define PSI_TRIGGER "some 300000 2000000"
+#define PSI_HOLD_SECONDS 10 // how long a trigger keeps the block urgent
+#define PSI_BUFFER_LEN 256
+
+enum PsiResource { PSI_CPU, PSI_MEMORY, PSI_IO, PSI_COUNT };
+
+void psi_open(void);
+int psi_trigger_fd(enum PsiResource resource);
+void psi_triggered(enum PsiResource resource);
+int8_t psi_sample(void);
+uint16_t psi_avg10(enum PsiResource resource);
+int8_t psi_stalled(enum PsiResource resource);
+
+#endif // PSI_H
@@ -0,0 +1,65 @@
+#include "rate.h"
+
+#include <stdint.h>
+
+/*
+ * A fixed ring of rate samples with a running average and peak, cheap
+ * enough to feed on every refresh forever: pushing a sample is a store and
+ * a shift, and only evicting the peak makes it scan the ring again.
+ */
+
+#define RATE_INDEX(n) ((n) & (RATE_HISTORY_LEN - 1))
+
+void rate_push(struct rate_history *history, uint64_t rate) {
+  uint64_t *slot = &history->samples[RATE_INDEX(history->count)];
+  uint64_t evicted = history->count >= RATE_HISTORY_LEN ? *slot : 0;
+  uint64_t scaled = rate << RATE_FIXED_BITS;
+  uint32_t i;
+
+  *slot = rate;
+
+  /* The first sample seeds the average instead of creeping up from 0 */
+  if (history->count == 0) {
+    history->average = scaled;
+  } else if (scaled >= history->average) {
+    history->average += (scaled - history->average) >> RATE_EWMA_SHIFT;
+  } else {
+    history->average -= (history->average - scaled) >> RATE_EWMA_SHIFT;
+  }
+
+  history->count++;
+
+  if (rate >= history->peak) {
+    history->peak = rate;
+  } else if (evicted == history->peak) {
+    history->peak = 0;
+    for (i = 0; i < RATE_HISTORY_LEN; i++) {
+      if (history->samples[i] > history->peak) {
+        history->peak = history->samples[i];
+      }
+    }
+  }
+}
+
+uint64_t rate_average(const struct rate_history *history) {
+  return history->average >> RATE_FIXED_BITS;
+}
+
+uint64_t rate_peak(const struct rate_history *history) {
+  return history->peak;
+}
+
+/* Samples in the ring, at most RATE_HISTORY_LEN */
+uint32_t rate_samples(const struct rate_history *history) {
+  return history->count < RATE_HISTORY_LEN ? history->count
+                                           : RATE_HISTORY_LEN;
+}
+
+/* The sample `age` pushes ago, 0 being the newest */
+uint64_t rate_sample(const struct rate_history *history, uint32_t age) {
+  if (age >= rate_samples(history)) {
+    return 0;
+  }
+
+  return history->samples[RATE_INDEX(history->count - 1 - age)];
+}
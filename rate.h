@@ -0,0 +1,24 @@
+#ifndef RATE_H
+#define RATE_H
+
+#include <stdint.h>
+
+#define RATE_HISTORY_LEN 64 // samples kept, a power of two
+#define RATE_EWMA_SHIFT 2   // a new sample weighs 1/4 in the average
+#define RATE_FIXED_BITS 8   // fraction bits of the average
+
+/* The last RATE_HISTORY_LEN rates of a counter, in bytes per second */
+struct rate_history {
+  uint64_t samples[RATE_HISTORY_LEN];
+  uint64_t average; // EWMA with RATE_FIXED_BITS fraction bits
+  uint64_t peak;    // largest sample still in the ring
+  uint32_t count;   // samples pushed so far
+};
+
+void rate_push(struct rate_history *history, uint64_t rate);
+uint64_t rate_average(const struct rate_history *history);
+uint64_t rate_peak(const struct rate_history *history);
+uint32_t rate_samples(const struct rate_history *history);
+uint64_t rate_sample(const struct rate_history *history, uint32_t age);
+
+#endif // RATE_H
@@ -0,0 +1,692 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "clock.h"
+#include "replay.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Record and replay of everything the collectors read from the system: file
+ * contents, directory listings, D-Bus replies and the few values that come
+ * from elsewhere (Pulse sink fields, ioctls). Collectors go through the
+ * replay_* wrappers, which are plain syscalls unless --record or --replay
+ * is given.
+ *
+ * Under syscall_count.so every record also holds the system calls its live
+ * call made, which replaying it charges again, so --budget sees the same
+ * counts on every run of a recording.
+ *
+ * A recording is a header followed by records, each a struct replay_record,
+ * its NUL terminated key and its data, padded to 8 bytes. Records with the
+ * same kind and key form a stream; replaying hands out the records of a
+ * stream in order, starting over when it runs out.
+ */
+
+struct replay_header {
+  uint32_t magic;
+  uint32_t flags;
+};
+
+struct replay_record {
+  int64_t time;     // CLOCK_MONOTONIC nanoseconds
+  uint32_t next;    // offset of the next record of the stream, set on load
+  uint16_t kind;
+  uint16_t key_len; // including the NUL
+  int32_t status;   // errno of the failed call, 0 on success
+  uint32_t len;     // bytes of data after the key
+  uint32_t calls;   // system calls the live call made
+  uint32_t reserved;
+};
+
+#define RECORD_ALIGN 8
+#define RECORD_PAD(len)                                                        \
+  (((len) + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1))
+
+struct replay_stream {
+  const char *key; // NULL for an unused slot
+  uint16_t kind;
+  uint32_t first; // record offsets, 0 for none
+  uint32_t last;
+  uint32_t cursor;
+};
+
+static enum ReplayMode mode = REPLAY_OFF;
+static uint32_t header_flags = 0; // of the recording made or played
+static uint32_t charged = 0;      // recorded calls of the replayed inputs
+static uint32_t hidden = 0;       // writing the recording took
+static struct replay_stream streams[REPLAY_MAX_STREAMS];
+
+/* Recording */
+static int record_fd = -1;
+static char buffer[REPLAY_BUFFER_LEN];
+static size_t buffered = 0;
+static char key_pool[REPLAY_KEY_POOL_LEN];
+static size_t key_pool_used = 0;
+static int16_t fd_streams[REPLAY_MAX_FDS]; // stream of each open file, + 1
+
+/* Playing */
+static char *recording;
+static size_t recording_len;
+static uint32_t frame_count = 0;
+static int64_t replay_time = 0;
+
+/* In syscall_count.so, when it is preloaded */
+extern uint32_t syscall_count(void) __attribute__((weak));
+
+static uint32_t live_calls(void) {
+  return syscall_count ? syscall_count() : 0;
+}
+
+static int64_t monotonic_nanoseconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t hash_key(uint16_t kind, const char *key) {
+  uint32_t hash = 2166136261u ^ kind;
+
+  while (*key) {
+    hash = (hash ^ (unsigned char)*key++) * 16777619u;
+  }
+
+  return hash;
+}
+
+/* Index of the stream for kind and key, -1 when absent and not `add`ed */
+static int find_stream(uint16_t kind, const char *key, int8_t add) {
+  uint32_t i = hash_key(kind, key) & (REPLAY_MAX_STREAMS - 1);
+  uint32_t probes;
+  size_t len;
+
+  for (probes = 0; probes < REPLAY_MAX_STREAMS; probes++) {
+    if (streams[i].key == NULL) {
+      break;
+    }
+    if (streams[i].kind == kind && strcmp(streams[i].key, key) == 0) {
+      return i;
+    }
+    i = (i + 1) & (REPLAY_MAX_STREAMS - 1);
+  }
+
+  if (!add || probes == REPLAY_MAX_STREAMS) {
+    return -1;
+  }
+
+  /* Keys of a recording live in the file, while recording in the pool */
+  if (mode == REPLAY_RECORDING) {
+    len = strlen(key) + 1;
+    if (len > REPLAY_KEY_POOL_LEN - key_pool_used) {
+      return -1;
+    }
+    streams[i].key = memcpy(key_pool + key_pool_used, key, len);
+    key_pool_used += len;
+  } else {
+    streams[i].key = key;
+  }
+  streams[i].kind = kind;
+
+  return i;
+}
+
+/* -----RECORDING----- */
+
+static void flush(void) {
+  uint32_t before = live_calls();
+  size_t written = 0;
+  ssize_t count;
+
+  while (written < buffered) {
+    if ((count = write(record_fd, buffer + written, buffered - written)) ==
+        -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("write() failed!");
+      break;
+    }
+    written += count;
+  }
+
+  buffered = 0;
+  hidden += live_calls() - before;
+}
+
+static void append(const void *data, size_t len) {
+  size_t chunk;
+
+  while (len > 0) {
+    if (buffered == sizeof(buffer)) {
+      flush();
+    }
+
+    chunk = sizeof(buffer) - buffered;
+    if (chunk > len) {
+      chunk = len;
+    }
+
+    memcpy(buffer + buffered, data, chunk);
+    buffered += chunk;
+    data = (const char *)data + chunk;
+    len -= chunk;
+  }
+}
+
+int8_t replay_record(const char *path) {
+  struct replay_header header = {REPLAY_MAGIC, 0};
+
+  if (syscall_count) {
+    header.flags = header_flags = REPLAY_COUNTED;
+  }
+
+  if ((record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  mode = REPLAY_RECORDING;
+  append(&header, sizeof(header));
+
+  return 1;
+}
+
+/*
+ * Append a record of an input the collectors got from a live call, along
+ * with the system calls made since replay_calls() returned `since`
+ */
+void replay_capture(enum ReplayKind kind, const char *key, const void *data,
+                    size_t len, int status, uint32_t since) {
+  static const char padding[RECORD_ALIGN];
+  struct replay_record record;
+  size_t key_len = strlen(key) + 1;
+  int saved_errno = errno; // callers still look at the recorded call's errno
+
+  if (mode != REPLAY_RECORDING || key_len > REPLAY_KEY_LEN) {
+    return;
+  }
+
+  record.time = monotonic_nanoseconds();
+  record.next = 0;
+  record.kind = kind;
+  record.key_len = key_len;
+  record.status = status;
+  record.len = data ? len : 0;
+  record.calls = replay_calls() - since;
+  record.reserved = 0;
+
+  append(&record, sizeof(record));
+  append(key, key_len);
+  append(data, record.len);
+  append(padding, RECORD_PAD(key_len + record.len) - (key_len + record.len));
+
+  errno = saved_errno;
+}
+
+/* -----PLAYING----- */
+
+/* Map a recording and chain the records of each stream */
+int8_t replay_load(const char *path) {
+  struct replay_record *record;
+  struct replay_stream *stream;
+  const char *key;
+  struct stat st;
+  size_t offset;
+  void *map;
+  int fd, index;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  if (fstat(fd, &st) == -1 ||
+      (size_t)st.st_size < sizeof(struct replay_header)) {
+    fprintf(stderr, "%s: not a recording\n", path);
+    close(fd);
+    return 0;
+  }
+
+  /* Private and writable: the `next` links are filled in below */
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    perror("mmap() failed!");
+    return 0;
+  }
+
+  recording = map;
+  recording_len = st.st_size;
+
+  if (((struct replay_header *)recording)->magic != REPLAY_MAGIC) {
+    fprintf(stderr, "%s: not a recording\n", path);
+    return 0;
+  }
+
+  mode = REPLAY_PLAYING;
+  header_flags = ((struct replay_header *)recording)->flags;
+
+  for (offset = sizeof(struct replay_header);
+       offset + sizeof(*record) <= recording_len;
+       offset += sizeof(*record) + RECORD_PAD(record->key_len + record->len)) {
+    record = (struct replay_record *)(recording + offset);
+    key = (const char *)(record + 1);
+
+    if (record->key_len == 0 ||
+        offset + sizeof(*record) + record->key_len + record->len >
+            recording_len ||
+        key[record->key_len - 1] != '\0') {
+      fprintf(stderr, "%s: truncated at byte %zu\n", path, offset);
+      break;
+    }
+
+    if (record->kind == REPLAY_FRAME) {
+      frame_count++;
+    }
+
+    if ((index = find_stream(record->kind, key, 1)) == -1) {
+      fprintf(stderr, "%s: more than %d inputs\n", path, REPLAY_MAX_STREAMS);
+      return 0;
+    }
+
+    stream = &streams[index];
+    if (stream->last) {
+      ((struct replay_record *)(recording + stream->last))->next = offset;
+    } else {
+      stream->first = stream->cursor = offset;
+    }
+    stream->last = offset;
+  }
+
+  return 1;
+}
+
+static const struct replay_record *next_record(int index) {
+  struct replay_stream *stream = &streams[index];
+  const struct replay_record *record;
+
+  if (!stream->first) {
+    return NULL;
+  }
+
+  record = (const struct replay_record *)(recording + stream->cursor);
+  stream->cursor = record->next ? record->next : stream->first;
+  replay_time = record->time;
+  charged += record->calls;
+
+  return record;
+}
+
+/*
+ * The data of the next record for kind and key, NULL when the recording
+ * has none. `status` receives the errno of the recorded call.
+ */
+const void *replay_next(enum ReplayKind kind, const char *key, size_t *len,
+                        int *status) {
+  const struct replay_record *record;
+  int index;
+
+  if (mode != REPLAY_PLAYING || (index = find_stream(kind, key, 0)) == -1 ||
+      (record = next_record(index)) == NULL) {
+    return NULL;
+  }
+
+  *len = record->len;
+  *status = record->status;
+
+  return (const char *)(record + 1) + record->key_len;
+}
+
+/* -----SHARED----- */
+
+enum ReplayMode replay_mode(void) { return mode; }
+
+/* Frames in the recording being played */
+uint32_t replay_frames(void) { return frame_count; }
+
+/*
+ * Mark a printed frame along with the modules updated for it, or step to
+ * the next recorded frame and return the modules to update for it.
+ */
+uint32_t replay_frame(uint32_t updated) {
+  const uint32_t *recorded;
+  size_t len;
+  int status;
+
+  if (mode == REPLAY_RECORDING) {
+    replay_capture(REPLAY_FRAME, "", &updated, sizeof(updated), 0,
+                   replay_calls());
+    flush();
+  } else if (mode == REPLAY_PLAYING) {
+    recorded = replay_next(REPLAY_FRAME, "", &len, &status);
+    if (recorded == NULL || len != sizeof(*recorded)) {
+      return 0;
+    }
+    memcpy(&updated, recorded, sizeof(updated));
+  }
+
+  return updated;
+}
+
+/*
+ * System calls made so far: those counted live, less the writes of a
+ * recording, and those of every replayed input as it was recorded
+ */
+uint32_t replay_calls(void) { return live_calls() - hidden + charged; }
+
+/* Whether replay_calls() counts real system calls */
+int8_t replay_counting(void) {
+  return syscall_count &&
+         (mode != REPLAY_PLAYING || (header_flags & REPLAY_COUNTED));
+}
+
+/* Monotonic time, or the time of the last replayed input */
+int64_t replay_clock_ms(void) {
+  if (mode == REPLAY_PLAYING) {
+    return replay_time / 1000000;
+  }
+
+  return monotonic_nanoseconds() / 1000000;
+}
+
+/* -----FILES----- */
+
+/*
+ * A replayed descriptor is REPLAY_FD_BASE plus the index of its REPLAY_OPEN
+ * stream, whose key finds the reads and the close of the file.
+ */
+static const struct replay_record *next_of_file(enum ReplayKind kind, int fd) {
+  int index = fd - REPLAY_FD_BASE;
+
+  if (index < 0 || index >= REPLAY_MAX_STREAMS || streams[index].key == NULL ||
+      (index = find_stream(kind, streams[index].key, 0)) == -1) {
+    return NULL;
+  }
+
+  return next_record(index);
+}
+
+int replay_open(const char *path, int flags) {
+  const struct replay_record *record;
+  uint32_t since = replay_calls();
+  int fd, index;
+
+  if (mode == REPLAY_PLAYING) {
+    if ((index = find_stream(REPLAY_OPEN, path, 0)) == -1 ||
+        (record = next_record(index)) == NULL) {
+      errno = ENOENT;
+      return -1;
+    }
+    if (record->status != 0) {
+      errno = record->status;
+      return -1;
+    }
+
+    return REPLAY_FD_BASE + index;
+  }
+
+  fd = open(path, flags);
+
+  if (mode == REPLAY_RECORDING) {
+    replay_capture(REPLAY_OPEN, path, NULL, 0, fd == -1 ? errno : 0, since);
+    if (fd >= 0 && fd < REPLAY_MAX_FDS) {
+      fd_streams[fd] = find_stream(REPLAY_OPEN, path, 1) + 1;
+    }
+  }
+
+  return fd;
+}
+
+/* pread() from offset 0, which is all the collectors ever do */
+ssize_t replay_pread(int fd, void *buf, size_t len) {
+  const struct replay_record *record;
+  uint32_t since = replay_calls();
+  ssize_t count;
+
+  if (mode == REPLAY_PLAYING) {
+    if ((record = next_of_file(REPLAY_READ, fd)) == NULL) {
+      errno = EBADF;
+      return -1;
+    }
+    if (record->status != 0) {
+      errno = record->status;
+      return -1;
+    }
+
+    count = record->len < len ? record->len : len;
+    memcpy(buf, (const char *)(record + 1) + record->key_len, count);
+    return count;
+  }
+
+  count = pread(fd, buf, len, 0);
+
+  if (mode == REPLAY_RECORDING && fd >= 0 && fd < REPLAY_MAX_FDS &&
+      fd_streams[fd] > 0) {
+    replay_capture(REPLAY_READ, streams[fd_streams[fd] - 1].key, buf,
+                   count > 0 ? count : 0, count == -1 ? errno : 0, since);
+  }
+
+  return count;
+}
+
+void replay_close(int fd) {
+  uint32_t since = replay_calls();
+
+  if (mode == REPLAY_PLAYING && fd >= REPLAY_FD_BASE) {
+    next_of_file(REPLAY_CLOSE, fd);
+    return;
+  }
+
+  close(fd);
+
+  if (fd >= 0 && fd < REPLAY_MAX_FDS) {
+    if (mode == REPLAY_RECORDING && fd_streams[fd] > 0) {
+      replay_capture(REPLAY_CLOSE, streams[fd_streams[fd] - 1].key, NULL, 0,
+                     0, since);
+    }
+    fd_streams[fd] = 0;
+  }
+}
+
+/* -----D-BUS----- */
+
+/* Stands in for the system bus while playing; never dereferenced */
+static char replayed_bus;
+
+/*
+ * Calls that were still unanswered when their module ran out of time. They
+ * stay on the bus, and the next refresh making the same call waits for the
+ * reply that is on its way instead of asking again.
+ */
+struct pending_call {
+  DBusPendingCall *call; // NULL for a free slot
+  DBusConnection *conn;
+  int64_t sent; // replay_clock_ms()
+  char key[REPLAY_KEY_LEN];
+};
+
+static struct pending_call pending_calls[REPLAY_MAX_PENDING];
+
+DBusConnection *replay_dbus_bus(DBusError *error) {
+  if (mode == REPLAY_PLAYING) {
+    return (DBusConnection *)&replayed_bus;
+  }
+
+  return dbus_bus_get(DBUS_BUS_SYSTEM, error);
+}
+
+void replay_dbus_unref(DBusConnection *conn) {
+  if (mode != REPLAY_PLAYING) {
+    dbus_connection_unref(conn);
+  }
+}
+
+/* "path interface.member arg..." with the string arguments of the call */
+static void call_key(DBusMessage *msg, char *key, size_t size) {
+  DBusMessageIter iter;
+  const char *arg;
+  size_t len;
+
+  len = snprintf(key, size, "%s %s.%s", dbus_message_get_path(msg),
+                 dbus_message_get_interface(msg),
+                 dbus_message_get_member(msg));
+
+  if (!dbus_message_iter_init(msg, &iter)) {
+    return;
+  }
+
+  do {
+    if (len >= size) {
+      return;
+    }
+    if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_STRING) {
+      dbus_message_iter_get_basic(&iter, &arg);
+      len += snprintf(key + len, size - len, " %s", arg);
+    }
+  } while (dbus_message_iter_next(&iter));
+}
+
+static void forget_call(struct pending_call *pending) {
+  if (!dbus_pending_call_get_completed(pending->call)) {
+    dbus_pending_call_cancel(pending->call);
+  }
+  dbus_pending_call_unref(pending->call);
+  dbus_connection_unref(pending->conn);
+  pending->call = NULL;
+}
+
+/* The call made with `key` that is still on its way, or a new one */
+static struct pending_call *send_call(DBusConnection *conn, DBusMessage *msg,
+                                      const char *key, DBusError *error) {
+  struct pending_call *pending, *free_slot = NULL;
+  size_t i;
+
+  for (i = 0; i < REPLAY_MAX_PENDING; i++) {
+    pending = &pending_calls[i];
+    if (pending->call == NULL) {
+      free_slot = free_slot ? free_slot : pending;
+    } else if (pending->conn == conn && strcmp(pending->key, key) == 0) {
+      return pending;
+    }
+  }
+
+  if (free_slot == NULL) {
+    dbus_set_error_const(error, DBUS_ERROR_LIMITS_EXCEEDED,
+                         "too many calls waiting for a reply");
+    return NULL;
+  }
+
+  if (!dbus_connection_send_with_reply(conn, msg, &free_slot->call,
+                                       DBUS_TIMEOUT_INFINITE) ||
+      free_slot->call == NULL) {
+    dbus_set_error_const(error, DBUS_ERROR_DISCONNECTED,
+                         "the bus connection is closed");
+    free_slot->call = NULL;
+    return NULL;
+  }
+
+  free_slot->conn = dbus_connection_ref(conn);
+  free_slot->sent = replay_clock_ms();
+  snprintf(free_slot->key, sizeof(free_slot->key), "%s", key);
+
+  return free_slot;
+}
+
+/*
+ * Wait for the reply until the deadline of the running module. A call that
+ * gets none in time stays pending; one that gets none in REPLAY_PENDING_MS
+ * is given up for good.
+ */
+static DBusMessage *wait_for_reply(struct pending_call *pending,
+                                   DBusError *error) {
+  DBusMessage *reply;
+  int left;
+
+  while (!dbus_pending_call_get_completed(pending->call) &&
+         replay_clock_ms() - pending->sent < REPLAY_PENDING_MS) {
+    if ((left = clock_deadline_left()) == 0) {
+      dbus_set_error_const(error, DBUS_ERROR_NO_REPLY,
+                           "the reply is still on its way");
+      return NULL;
+    }
+    if (!dbus_connection_read_write_dispatch(
+            pending->conn, left < 0 ? REPLAY_PENDING_MS : left)) {
+      break;
+    }
+  }
+
+  reply = dbus_pending_call_steal_reply(pending->call);
+  forget_call(pending);
+
+  if (reply == NULL) {
+    dbus_set_error_const(error, DBUS_ERROR_NO_REPLY, "no reply");
+  } else if (dbus_set_error_from_message(error, reply)) {
+    dbus_message_unref(reply);
+    reply = NULL;
+  }
+
+  return reply;
+}
+
+/*
+ * A method call on the system bus, waiting no longer than the deadline of
+ * the running module; see pending_calls for what happens after it
+ */
+DBusMessage *replay_dbus_call(DBusConnection *conn, DBusMessage *msg,
+                              DBusError *error) {
+  struct pending_call *pending;
+  char key[REPLAY_KEY_LEN];
+  const char *member;
+  DBusMessage *reply;
+  const void *data;
+  char *marshalled;
+  int marshalled_len, status;
+  uint32_t since = replay_calls();
+  size_t len;
+
+  if ((member = dbus_message_get_member(msg)) == NULL) {
+    member = "D-Bus call";
+  }
+  trace_begin(member);
+
+  call_key(msg, key, sizeof(key));
+
+  if (mode == REPLAY_PLAYING) {
+    if ((data = replay_next(REPLAY_DBUS, key, &len, &status)) == NULL ||
+        status != 0) {
+      dbus_set_error_const(error, "org.freedesktop.DBus.Error.Failed",
+                           "no recorded reply");
+      reply = NULL;
+    } else {
+      reply = dbus_message_demarshal(data, len, error);
+    }
+  } else if ((pending = send_call(conn, msg, key, error)) == NULL) {
+    reply = NULL;
+  } else {
+    reply = wait_for_reply(pending, error);
+  }
+
+  if (mode == REPLAY_RECORDING) {
+    if (reply && dbus_message_marshal(reply, &marshalled, &marshalled_len)) {
+      replay_capture(REPLAY_DBUS, key, marshalled, marshalled_len, 0, since);
+      dbus_free(marshalled);
+    } else {
+      replay_capture(REPLAY_DBUS, key, NULL, 0, EIO, since);
+    }
+  }
+
+  trace_end(member);
+  return reply;
+}
@@ -0,0 +1,56 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <dbus/dbus.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define REPLAY_MAGIC 0x32435254 // "TRC2"
+#define REPLAY_COUNTED 1 // header flag: recorded under syscall_count.so
+#define REPLAY_BUFFER_LEN (64 * 1024)
+#define REPLAY_MAX_STREAMS 1024 // distinct inputs, a power of two
+#define REPLAY_KEY_POOL_LEN (64 * 1024)
+#define REPLAY_KEY_LEN 512
+#define REPLAY_MAX_FDS 1024
+#define REPLAY_FD_BASE (1 << 20) // replayed descriptors, never real ones
+#define REPLAY_MAX_PENDING 8 // D-Bus calls still waiting for their reply
+#define REPLAY_PENDING_MS 25000 // libdbus's default reply timeout
+
+/* What a recorded input is; together with its key it names a stream */
+enum ReplayKind {
+  REPLAY_OPEN,  // whether a file could be opened
+  REPLAY_READ,  // the bytes a pread() returned
+  REPLAY_CLOSE, // a file was closed
+  REPLAY_DIR,   // the names a directory scan saw, NUL separated
+  REPLAY_DBUS,  // a marshalled method reply
+  REPLAY_VALUE, // any other collector input, as raw bytes
+  REPLAY_FRAME  // a frame was printed
+};
+
+enum ReplayMode { REPLAY_OFF, REPLAY_RECORDING, REPLAY_PLAYING };
+
+int8_t replay_record(const char *path);
+int8_t replay_load(const char *path);
+enum ReplayMode replay_mode(void);
+uint32_t replay_frames(void);
+uint32_t replay_frame(uint32_t updated);
+int64_t replay_clock_ms(void);
+uint32_t replay_calls(void);
+int8_t replay_counting(void);
+
+void replay_capture(enum ReplayKind kind, const char *key, const void *data,
+                    size_t len, int status, uint32_t since);
+const void *replay_next(enum ReplayKind kind, const char *key, size_t *len,
+                        int *status);
+
+int replay_open(const char *path, int flags);
+ssize_t replay_pread(int fd, void *buf, size_t len);
+void replay_close(int fd);
+
+DBusConnection *replay_dbus_bus(DBusError *error);
+DBusMessage *replay_dbus_call(DBusConnection *conn, DBusMessage *msg,
+                              DBusError *error);
+void replay_dbus_unref(DBusConnection *conn);
+
+#endif // REPLAY_H
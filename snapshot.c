@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * The last values of every field, kept in a file on the runtime tmpfs and
+ * mapped shared. Storing a value is a memcpy() into the mapping, so keeping
+ * it current costs no syscalls; the next start maps the same file and has
+ * something to show before the first collector returns.
+ */
+
+struct snapshot_header {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t value_len;
+};
+
+static struct snapshot_header *header;
+static char *snapshot_values;
+static size_t value_count = 0;
+
+/*
+ * Map the snapshot for `count` values. Returns whether it holds values from
+ * an earlier run; a missing or foreign file is reset to empty values.
+ */
+int8_t snapshot_open(size_t count) {
+  char path[PATH_MAX];
+  const char *runtime_dir;
+  size_t size = sizeof(*header) + count * SNAPSHOT_VALUE_LEN;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL ||
+      (size_t)snprintf(path, sizeof(path), "%s%s", runtime_dir,
+                       SNAPSHOT_FILE) >= sizeof(path)) {
+    return 0;
+  }
+
+  if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  if (fstat(fd, &st) == -1 ||
+      ((size_t)st.st_size != size && ftruncate(fd, size) == -1)) {
+    perror("ftruncate() failed!");
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    perror("mmap() failed!");
+    return 0;
+  }
+
+  header = map;
+  snapshot_values = (char *)map + sizeof(*header);
+  value_count = count;
+
+  if (header->magic == SNAPSHOT_MAGIC && header->count == count &&
+      header->value_len == SNAPSHOT_VALUE_LEN) {
+    return 1;
+  }
+
+  memset(snapshot_values, 0, count * SNAPSHOT_VALUE_LEN);
+  header->magic = SNAPSHOT_MAGIC;
+  header->count = count;
+  header->value_len = SNAPSHOT_VALUE_LEN;
+
+  return 0;
+}
+
+/* The value stored at `index`, empty when there is no snapshot */
+const char *snapshot_value(size_t index) {
+  if (index >= value_count) {
+    return "";
+  }
+
+  return snapshot_values + index * SNAPSHOT_VALUE_LEN;
+}
+
+/* Values longer than SNAPSHOT_VALUE_LEN are cut */
+void snapshot_store(size_t index, const char *value) {
+  char *slot;
+  size_t len;
+
+  if (index >= value_count) {
+    return;
+  }
+
+  slot = snapshot_values + index * SNAPSHOT_VALUE_LEN;
+
+  /* Unchanged values do not dirty the page */
+  if (strncmp(slot, value, SNAPSHOT_VALUE_LEN - 1) == 0) {
+    return;
+  }
+
+  /* Cut long values on a UTF-8 character boundary */
+  len = strlen(value);
+  if (len > SNAPSHOT_VALUE_LEN - 1) {
+    len = SNAPSHOT_VALUE_LEN - 1;
+    while (len > 0 && ((unsigned char)value[len] & 0xc0) == 0x80) {
+      len--;
+    }
+  }
+
+  memcpy(slot, value, len);
+  slot[len] = '\0';
+}
@@ -0,0 +1,15 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_FILE "/status.snapshot" // under $XDG_RUNTIME_DIR
+#define SNAPSHOT_MAGIC 0x31534e53        // "SNS1"
+#define SNAPSHOT_VALUE_LEN 256
+
+int8_t snapshot_open(size_t count);
+const char *snapshot_value(size_t index);
+void snapshot_store(size_t index, const char *value);
+
+#endif // SNAPSHOT_H
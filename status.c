@@ -1,26 +1,68 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "arena.h"
+#include "backlight.h"
 #include "battery.h"
+#include "block.h"
+#include "budget.h"
 #include "bluetooth.h"
+#include "clock.h"
+#include "config.h"
+#include "cpu.h"
+#include "disk.h"
+#include "format.h"
+#include "i3bar.h"
+#include "json.h"
+#include "memory.h"
 #include "network.h"
+#include "power.h"
+#include "psi.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "thermal.h"
+#include "trace.h"
+#include "uevent.h"
 #include "volume.h"
+#include "wifi.h"
+#include "x11.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/signalfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #define SEPARATOR_SYMBOL " : "
+#define DEFAULT_FORMAT                                                         \
+  "{vol}" SEPARATOR_SYMBOL "{bat}" SEPARATOR_SYMBOL "{net}" SEPARATOR_SYMBOL   \
+  "{bt}" SEPARATOR_SYMBOL "{date}" SEPARATOR_SYMBOL "{time}"
+#define DEFAULT_INTERVAL_SECONDS 1
+#define FRAME_BUFFER_LEN 4096
+#define VOLUME_STEP_PERCENT 5
+#define CONFIG_REPLAY_KEY "config"
+#define DEFAULT_DEADLINE_MS 20
+#define BACKOFF_MAX_INTERVALS 64
+
+#define COLOR_DEGRADED "#f1fa8c"
+#define COLOR_BAD "#ff5555"
+#define COLOR_STALE "#6272a4" // values from the last run, not collected yet
 
 const char *VolumeIcons[] = {
     "\uf485",     // SPEAKER
     "\U000F02CB", // HEADPHONE
     "\U000F00B0", // BT_HEADSET
-    "\uf466"      // MUTE
+    "\uf466",     // MUTE
+    "\uf130",     // MIC
+    "\uf131"      // MIC_MUTE
 };
 
 // VolumeIcon enum defined in volume.h
 
-#define RFKILL_DEV_NAME_LEN 10
-
 const char *NetworkIcons[] = {
     "\uf1eb ", // ENABLED
     "\uf072", // DISABLED
@@ -28,11 +70,13 @@ const char *NetworkIcons[] = {
     "\uf093 " // UPLOAD
 };
 
+#define BACKLIGHT_ICON "\uf185"
+
 enum NetworkIcon { IC_NT_ENABLED, IC_NT_DISABLED, IC_DOWNLOAD, IC_UPLOAD };
 
-#define BAT_NAME_LEN 5
-#define BAT_STATUS_LEN 12
 #define BAT_CHARGING_STATE "Charging"
+#define BAT_LOW_CAPACITY 20
+#define BAT_CRITICAL_CAPACITY 10
 
 const char *BatteryIcons[] = {
     "\U000f007a", // EMPTY
@@ -52,8 +96,6 @@ enum BatteryIcon {
   IC_BAT_CHARGING
 };
 
-#define BLUETOOTH_DEVICE_NAME_LEN 50
-
 const char *BluetoothIcons[] = {
     "\uf294",     // ENABLED
     "\U000F00B1", // CONNECTED
@@ -62,124 +104,1705 @@ const char *BluetoothIcons[] = {
 
 enum BluetoothIcon { IC_BT_ENABLED, IC_BT_CONNECTED, IC_BT_DISABLED };
 
-#define DAYS_OF_WEEK {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"}
-#define MONTHS_OF_YEAR                                                         \
-  {"Jan", "Feb", "Mar", "Apr", "May", "Jun",                                   \
-   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"}
+#define CPU_ICON "\uf2db"
+#define CPU_HIGH_USAGE 90
 
-int main(void) {
+/* One block character per core, from idle to fully busy */
+const char *CpuBars[] = {"\u2581", "\u2582", "\u2583", "\u2584",
+                         "\u2585", "\u2586", "\u2587", "\u2588"};
 
-  char rfkill_device[RFKILL_DEV_NAME_LEN];
-  char battery_name[BAT_NAME_LEN];
-  char battery_status[BAT_STATUS_LEN];
-  char bluetooth_device_name[BLUETOOTH_DEVICE_NAME_LEN];
+#define CPU_BAR_LEVELS (sizeof(CpuBars) / sizeof(CpuBars[0]))
+#define CPU_BAR_BYTES 3 // every bar character is three bytes of UTF-8
 
-  float down_bytes, up_bytes;
-  int8_t battery_capacity;
+#define NET_GRAPH_WIDTH 8 // samples in the net_graph sparkline
+
+#define MEMORY_ICON "\uefc5"
+#define SWAP_ICON "\uf0ec"
+#define MEMORY_LOW_PERCENT 10 // available memory that turns the block degraded
+
+#define TEMP_ICON "\uf2c9"
+#define FAN_ICON "\U000F0210"
+#define TEMP_HOT 80      // degrees Celsius that turn the block degraded
+#define TEMP_CRITICAL 95 // and that make it urgent
+
+#define DISK_ICON "\uf0a0"
 
-  time_t current_time = time(NULL);
-  struct tm tm = *localtime(&current_time);
+#define PSI_ICON "\uf0e4"
+#define PSI_HIGH 1000 // avg10 in hundredths of a percent, i.e. 10%
 
-  const char *days_of_week[] = DAYS_OF_WEEK;
+#define FIELD_VALUE_LEN 16
 
-  const char *months_of_year[] = MONTHS_OF_YEAR;
+static struct format format, date_format, time_format;
+static int8_t date_format_changed = 0;
 
-  /* -----VOLUME----- */
+/* Values for template fields that are not a whole block */
+static char battery_time[FIELD_VALUE_LEN];
+static char net_down[FIELD_VALUE_LEN];
+static char net_up[FIELD_VALUE_LEN];
+static char net_graph[NET_GRAPH_WIDTH * CPU_BAR_BYTES + 1];
+static char net_peak[FIELD_VALUE_LEN];
+static char net_class[NET_CLASSES][2 * FIELD_VALUE_LEN]; // "down up"
+static char wifi_ssid[WIFI_SSID_LEN];
+static char wifi_signal[FIELD_VALUE_LEN];
+static char wifi_bitrate[FIELD_VALUE_LEN];
+static char cpu_bars[CPU_MAX_CORES * CPU_BAR_BYTES + 1];
+static char mem_avail[FIELD_VALUE_LEN];
+static char swap[sizeof(SWAP_ICON) + FIELD_VALUE_LEN];
+static char zswap[FIELD_VALUE_LEN];
+static char fan[sizeof(FAN_ICON) + FIELD_VALUE_LEN];
+static char disk_read[FIELD_VALUE_LEN];
+static char disk_write[FIELD_VALUE_LEN];
+static char disks[BLOCK_TEXT_LEN]; // "name read write" per device
+static char mic[FIELD_VALUE_LEN];
+
+/* -----VOLUME----- */
+
+/* The microphone: muted, or its level; empty without one */
+static void update_mic(void) {
+  mic[0] = '\0';
+
+  if (!mic_present()) {
+    return;
+  }
+
+  if (get_mic_mute()) {
+    snprintf(mic, sizeof(mic), "%s", VolumeIcons[IC_MIC_MUTE]);
+  } else {
+    snprintf(mic, sizeof(mic), "%s %hd%%", VolumeIcons[IC_MIC],
+             get_mic_volume());
+  }
+}
+
+static void update_volume(struct block *block) {
+  volume_refresh();
+  update_mic();
 
   if (!get_mute()) {
     enum VolumeIcon icon_type = get_volume_icon_type();
-    printf("%s %hd%%", VolumeIcons[icon_type], get_volume());
+    snprintf(block->full_text, sizeof(block->full_text), "%s %hd%%%s%s",
+             VolumeIcons[icon_type], get_volume(), mic[0] ? " " : "", mic);
   } else {
-    printf("%s", VolumeIcons[IC_MUTE]);
+    snprintf(block->full_text, sizeof(block->full_text), "%s%s%s",
+             VolumeIcons[IC_MUTE], mic[0] ? " " : "", mic);
+    block->color = COLOR_DEGRADED;
   }
 
-  printf(SEPARATOR_SYMBOL);
+  /* On air: something records from a live microphone */
+  if (mic_recording() && !get_mic_mute()) {
+    block->color = COLOR_BAD;
+  }
+}
 
-  /* -----BATTERY----- */
+static void click_volume(int button) {
+  switch (button) {
+  case BTN_LEFT:
+    volume_toggle_mute();
+    break;
+  case BTN_MIDDLE:
+    volume_toggle_mic_mute();
+    break;
+  case BTN_SCROLL_UP:
+    volume_adjust(VOLUME_STEP_PERCENT);
+    break;
+  case BTN_SCROLL_DOWN:
+    volume_adjust(-VOLUME_STEP_PERCENT);
+    break;
+  default:
+    break;
+  }
+}
+
+/* -----BACKLIGHT----- */
 
-  if (get_battery_name(battery_name)) {
-    get_battery_status(battery_name, battery_status);
-    battery_capacity = get_battery_capacity(battery_name);
+static void update_backlight(struct block *block) {
+  if (!backlight_sample()) {
+    return;
+  }
 
-    if (strncmp(battery_status, BAT_CHARGING_STATE, BAT_STATUS_LEN) == 0) {
-      printf("%s", BatteryIcons[IC_BAT_CHARGING]);
+  snprintf(block->full_text, sizeof(block->full_text), "%s %hd%%",
+           BACKLIGHT_ICON, backlight_percent());
+  snprintf(block->instance, sizeof(block->instance), "%s", backlight_name());
+}
+
+/* -----BATTERY----- */
+
+static void update_battery(struct block *block) {
+  char battery_name[BAT_NAME_LEN];
+  char battery_status[BAT_STATUS_LEN];
+  int8_t battery_capacity;
+  const char *icon;
+
+  battery_time[0] = '\0';
+
+  if (!get_battery_name(battery_name)) {
+    return;
+  }
+
+  get_battery_status(battery_name, battery_status);
+  battery_capacity = get_battery_capacity(battery_name);
+
+  if (strncmp(battery_status, BAT_CHARGING_STATE, BAT_STATUS_LEN) == 0) {
+    icon = BatteryIcons[IC_BAT_CHARGING];
+  } else {
+    if (battery_capacity < 20) {
+      icon = BatteryIcons[IC_BAT_EMPTY];
+    } else if (battery_capacity < 40) {
+      icon = BatteryIcons[IC_BAT_25];
+    } else if (battery_capacity < 60) {
+      icon = BatteryIcons[IC_BAT_50];
+    } else if (battery_capacity < 80) {
+      icon = BatteryIcons[IC_BAT_75];
     } else {
-      if (battery_capacity < 20) {
-        printf("%s", BatteryIcons[IC_BAT_EMPTY]);
-      } else if (battery_capacity < 40) {
-        printf("%s", BatteryIcons[IC_BAT_25]);
-      } else if (battery_capacity < 60) {
-        printf("%s", BatteryIcons[IC_BAT_50]);
-      } else if (battery_capacity < 80) {
-        printf("%s", BatteryIcons[IC_BAT_75]);
-      } else {
-        printf("%s", BatteryIcons[IC_BAT_100]);
-      }
+      icon = BatteryIcons[IC_BAT_100];
+    }
+
+    if (battery_capacity < BAT_LOW_CAPACITY) {
+      block->color = COLOR_BAD;
+    }
+    block->urgent = battery_capacity < BAT_CRITICAL_CAPACITY;
+  }
+
+  snprintf(block->full_text, sizeof(block->full_text), "%s %hd%%", icon,
+           battery_capacity);
+  snprintf(block->instance, sizeof(block->instance), "%s", battery_name);
+
+  if (format.fields & FIELD_BIT(FIELD_BAT_TIME)) {
+    int32_t minutes = get_battery_time_remaining(
+        battery_name, icon == BatteryIcons[IC_BAT_CHARGING]);
+
+    if (minutes >= 0) {
+      snprintf(battery_time, sizeof(battery_time), "%d:%02d", minutes / 60,
+               minutes % 60);
     }
+  }
+}
+
+/* -----NETWORK----- */
 
-    printf(" %hd%%", battery_capacity);
+/* Bytes per second with a binary prefix and one decimal, e.g. "1.5M/s" */
+static void format_rate(char *buf, size_t size, uint64_t bytes) {
+  static const char units[] = {'B', 'K', 'M', 'G', 'T'};
+  uint64_t tenths = bytes * 10;
+  size_t unit = 0;
+
+  while (tenths >= 10240 && unit + 1 < sizeof(units)) {
+    tenths /= 1024;
+    unit++;
   }
 
-  printf(SEPARATOR_SYMBOL);
+  /* Under 1024 whole units, or any number of T/s, which still fits */
+  snprintf(buf, size, "%u.%u%c/s", (unsigned)(tenths / 10),
+           (unsigned)(tenths % 10), units[unit]);
+}
 
-  /* -----NETWORK----- */
+/* The last NET_GRAPH_WIDTH rates as bars, scaled to the largest of them */
+static void format_sparkline(char *buf, const struct rate_history *history) {
+  uint32_t count = rate_samples(history), age;
+  uint64_t max = 0, sample;
+  char *p = buf;
 
-  find_rfkill_device(rfkill_device);
+  if (count > NET_GRAPH_WIDTH) {
+    count = NET_GRAPH_WIDTH;
+  }
 
-  if (network_is_enabled(rfkill_device)) {
-    if (network_is_connected()) {
-      get_bytes_transferred(&down_bytes, &up_bytes);
-      printf("%.2fkb/s %s %s %.2fkb/s", down_bytes, NetworkIcons[IC_DOWNLOAD],
-             NetworkIcons[IC_UPLOAD], up_bytes);
+  for (age = 0; age < count; age++) {
+    if ((sample = rate_sample(history, age)) > max) {
+      max = sample;
+    }
+  }
+
+  /* Oldest first, so the graph scrolls to the left */
+  for (age = count; age-- > 0;) {
+    sample = rate_sample(history, age);
+    memcpy(p, CpuBars[max ? sample * (CPU_BAR_LEVELS - 1) / max : 0],
+           CPU_BAR_BYTES);
+    p += CPU_BAR_BYTES;
+  }
+  *p = '\0';
+}
+
+/* "down up" of one class of interfaces, empty while none of them is up */
+static void format_class(char *buf, size_t size, enum NetClass net_class) {
+  char down[FIELD_VALUE_LEN], up[FIELD_VALUE_LEN];
+
+  if (!network_connected(net_class)) {
+    buf[0] = '\0';
+    return;
+  }
+
+  format_rate(down, sizeof(down),
+              rate_average(network_class_down_rates(net_class)));
+  format_rate(up, sizeof(up), rate_average(network_class_up_rates(net_class)));
+  snprintf(buf, size, "%s %s", down, up);
+}
+
+/* SSID, signal and bitrate of the Wi-Fi in use, empty without one */
+static void update_wifi(void) {
+  struct wifi_link link;
+  const char *device;
+
+  wifi_ssid[0] = '\0';
+  wifi_signal[0] = '\0';
+  wifi_bitrate[0] = '\0';
+
+  if ((device = network_wireless_interface()) == NULL ||
+      !wifi_link(device, &link) || link.ssid[0] == '\0') {
+    return;
+  }
+
+  strcpy(wifi_ssid, link.ssid);
+  snprintf(wifi_signal, sizeof(wifi_signal), "%ddBm", link.signal);
+  snprintf(wifi_bitrate, sizeof(wifi_bitrate), "%u.%uMb/s",
+           (unsigned)(link.bitrate / 10), (unsigned)(link.bitrate % 10));
+}
+
+static void update_network(struct block *block) {
+  char rfkill_device[RFKILL_DEV_NAME_LEN];
+  char *p = block->full_text;
+  size_t size = sizeof(block->full_text);
+  int written;
+  uint8_t c;
+
+  net_down[0] = '\0';
+  net_up[0] = '\0';
+  net_graph[0] = '\0';
+  net_peak[0] = '\0';
+  for (c = 0; c < NET_CLASSES; c++) {
+    net_class[c][0] = '\0';
+  }
+
+  if (!network_sample()) {
+    return;
+  }
+
+  if (!network_any_connected()) {
+    find_rfkill_device(rfkill_device);
+
+    if (network_is_enabled(rfkill_device)) {
+      snprintf(block->full_text, sizeof(block->full_text), "%s",
+               NetworkIcons[IC_NT_ENABLED]); // Diconnected
+    } else {
+      snprintf(block->full_text, sizeof(block->full_text), "%s",
+               NetworkIcons[IC_NT_DISABLED]); // Network disabled
+      block->color = COLOR_DEGRADED;
+    }
+    return;
+  }
+
+  /* The first sample has nothing to compare with; no rate beats a 0 */
+  if (network_has_rates()) {
+    for (c = 0; c < NET_CLASSES; c++) {
+      format_class(net_class[c], sizeof(net_class[c]), c);
+    }
+
+    format_rate(net_down, sizeof(net_down),
+                rate_average(network_down_rates()));
+    format_rate(net_up, sizeof(net_up), rate_average(network_up_rates()));
+    format_rate(net_peak, sizeof(net_peak),
+                rate_peak(network_total_rates()));
+    format_sparkline(net_graph, network_total_rates());
+  }
+  update_wifi();
+
+  /* The Wi-Fi icon and its network go first while associated */
+  if (wifi_ssid[0] != '\0' &&
+      (written = snprintf(p, size, "%s%s %s ", NetworkIcons[IC_NT_ENABLED],
+                          wifi_ssid, wifi_signal)) > 0 &&
+      (size_t)written < size) {
+    p += written;
+    size -= written;
+  }
+
+  if (net_down[0] != '\0') {
+    snprintf(p, size, "%s %s %s %s", net_down, NetworkIcons[IC_DOWNLOAD],
+             NetworkIcons[IC_UPLOAD], net_up);
+  } else {
+    snprintf(p, size, "%s %s", NetworkIcons[IC_DOWNLOAD],
+             NetworkIcons[IC_UPLOAD]);
+  }
+}
+
+/* -----BLUETOOTH----- */
+
+/* Every connected device by kind, e.g. "headset 80%, mouse 45%" */
+static void update_bluetooth(struct block *block) {
+  const struct bluetooth_object *device;
+  const char *separator = " ";
+  char *p = block->full_text;
+  size_t size = sizeof(block->full_text);
+  uint16_t cursor = 0;
+  int written;
+
+  if (!bluetooth_refresh() || !bluetooth_is_powered()) {
+    snprintf(block->full_text, sizeof(block->full_text), "%s",
+             BluetoothIcons[IC_BT_DISABLED]); // Bluetooth disabled
+    return;
+  }
+
+  if ((device = bluetooth_next_connected(&cursor)) == NULL) {
+    snprintf(block->full_text, sizeof(block->full_text), "%s",
+             BluetoothIcons[IC_BT_ENABLED]); // Enabled, not connected
+    return;
+  }
+
+  written = snprintf(p, size, "%s", BluetoothIcons[IC_BT_CONNECTED]);
+
+  for (; device != NULL; device = bluetooth_next_connected(&cursor)) {
+    p += written;
+    size -= written;
+
+    if (device->battery >= 0) {
+      written = snprintf(p, size, "%s%s %d%%", separator,
+                         bluetooth_class(device), device->battery);
     } else {
-      printf("%s", NetworkIcons[IC_NT_ENABLED]); // Diconnected
+      written = snprintf(p, size, "%s%s", separator, bluetooth_class(device));
+    }
+
+    if (written < 0 || (size_t)written >= size) {
+      break;
+    }
+    separator = ", ";
+  }
+}
+
+/* -----CPU----- */
+
+static void update_cpu(struct block *block) {
+  uint16_t core, cores;
+  uint8_t usage;
+  char *p = cpu_bars;
+
+  cpu_bars[0] = '\0';
+
+  if (!cpu_sample()) {
+    return;
+  }
+
+  usage = cpu_total_usage();
+  snprintf(block->full_text, sizeof(block->full_text), "%s %hhu%%", CPU_ICON,
+           usage);
+
+  if (usage >= CPU_HIGH_USAGE) {
+    block->color = COLOR_DEGRADED;
+  }
+
+  if (format.fields & FIELD_BIT(FIELD_CPU_BARS)) {
+    cores = cpu_core_count();
+    for (core = 0; core < cores; core++) {
+      usage = cpu_core_usage(core);
+      memcpy(p, CpuBars[usage * CPU_BAR_LEVELS / 101], CPU_BAR_BYTES);
+      p += CPU_BAR_BYTES;
+    }
+    *p = '\0';
+  }
+}
+
+/* -----MEMORY----- */
+
+/*
+ * kB as mebibytes, or gibibytes with one decimal once there is one; both
+ * numbers fit an unsigned, which keeps the text inside FIELD_VALUE_LEN
+ */
+static void format_kilobytes(char *buf, size_t size, uint64_t kilobytes) {
+  unsigned tenths = (unsigned)(kilobytes * 10 / (1024 * 1024));
+
+  if (tenths < 10) {
+    snprintf(buf, size, "%uM", (unsigned)(kilobytes / 1024));
+  } else {
+    snprintf(buf, size, "%u.%uG", tenths / 10, tenths % 10);
+  }
+}
+
+static void update_memory(struct block *block) {
+  char used[FIELD_VALUE_LEN], total[FIELD_VALUE_LEN];
+  uint64_t mem_total, available, swap_total;
+
+  mem_avail[0] = '\0';
+  swap[0] = '\0';
+  zswap[0] = '\0';
+
+  if (!memory_sample()) {
+    return;
+  }
+
+  mem_total = memory_value(MEM_TOTAL);
+  available = memory_value(MEM_AVAILABLE);
+
+  format_kilobytes(used, sizeof(used), mem_total - available);
+  format_kilobytes(total, sizeof(total), mem_total);
+  snprintf(block->full_text, sizeof(block->full_text), "%s %s/%s",
+           MEMORY_ICON, used, total);
+
+  if (available * 100 < mem_total * MEMORY_LOW_PERCENT) {
+    block->color = COLOR_DEGRADED;
+  }
+
+  format_kilobytes(mem_avail, sizeof(mem_avail), available);
+
+  /* Without swap configured the swap fields stay empty */
+  if ((swap_total = memory_value(MEM_SWAP_TOTAL)) > 0) {
+    format_kilobytes(used, sizeof(used),
+                     swap_total - memory_value(MEM_SWAP_FREE));
+    snprintf(swap, sizeof(swap), "%s %s", SWAP_ICON, used);
+    format_kilobytes(zswap, sizeof(zswap), memory_value(MEM_ZSWAP));
+  }
+}
+
+/* -----THERMAL----- */
+
+static void update_thermal(struct block *block) {
+  int32_t temp;
+
+  fan[0] = '\0';
+
+  if (!thermal_sample()) {
+    return;
+  }
+
+  if (thermal_has_temp()) {
+    temp = thermal_max_temp();
+    snprintf(block->full_text, sizeof(block->full_text), "%s %d\u00b0C",
+             TEMP_ICON, temp);
+
+    if (temp >= TEMP_CRITICAL) {
+      block->color = COLOR_BAD;
+      block->urgent = 1;
+    } else if (temp >= TEMP_HOT) {
+      block->color = COLOR_DEGRADED;
     }
+  }
+
+  if (thermal_has_fan()) {
+    snprintf(fan, sizeof(fan), "%s %drpm", FAN_ICON, thermal_max_fan());
+  }
+}
+
+/* -----DISK----- */
+
+/* Every selected device with its own rates, e.g. "sda 1.5M/s 0.0B/s" */
+static void format_disks(void) {
+  char read[FIELD_VALUE_LEN], write[FIELD_VALUE_LEN];
+  const struct disk_slot *device;
+  size_t len = 0;
+  uint16_t cursor = 0;
+  int written;
+
+  while (len < sizeof(disks) && (device = disk_next_selected(&cursor))) {
+    format_rate(read, sizeof(read), device->read_rate);
+    format_rate(write, sizeof(write), device->write_rate);
+
+    written = snprintf(disks + len, sizeof(disks) - len, "%s%s %s %s",
+                       len > 0 ? ", " : "", device->name, read, write);
+    if (written < 0) {
+      break;
+    }
+    len += written;
+  }
+}
+
+static void update_disk(struct block *block) {
+  disk_read[0] = '\0';
+  disk_write[0] = '\0';
+  disks[0] = '\0';
+
+  if (!disk_sample()) {
+    return;
+  }
+
+  format_rate(disk_read, sizeof(disk_read), disk_read_rate());
+  format_rate(disk_write, sizeof(disk_write), disk_write_rate());
+  snprintf(block->full_text, sizeof(block->full_text), "%s %s %s",
+           DISK_ICON, disk_read, disk_write);
+
+  if (format.fields & FIELD_BIT(FIELD_DISKS)) {
+    format_disks();
+  }
+}
+
+/* -----PRESSURE----- */
+
+/* Step over what snprintf() wrote, never past the terminating byte */
+static size_t psi_advance(int written, size_t left) {
+  if (written < 0) {
+    return 0;
+  }
+  return (size_t)written < left ? (size_t)written : left - 1;
+}
+
+static void update_psi(struct block *block) {
+  static const char *labels[PSI_COUNT] = {
+      [PSI_CPU] = "cpu", [PSI_MEMORY] = "mem", [PSI_IO] = "io"};
+  char *p = block->full_text, *end = p + sizeof(block->full_text);
+  uint16_t avg;
+  int i;
+
+  if (!psi_sample()) {
+    return;
+  }
+
+  p += psi_advance(snprintf(p, end - p, "%s", PSI_ICON), end - p);
+
+  for (i = 0; i < PSI_COUNT; i++) {
+    avg = psi_avg10(i);
+    p += psi_advance(snprintf(p, end - p, " %s %u%%", labels[i], avg / 100),
+                     end - p);
+
+    /*
+     * The trigger sees a 2 s window and the text shows 10 s, so the block
+     * only turns urgent once the shown average agrees with the trigger
+     */
+    if (psi_stalled(i) && avg >= PSI_HIGH) {
+      block->color = COLOR_BAD;
+      block->urgent = 1;
+    } else if ((psi_stalled(i) || avg >= PSI_HIGH) && !block->urgent) {
+      block->color = COLOR_DEGRADED;
+    }
+  }
+}
+
+/* -----DATE----- */
+
+static void update_date(struct block *block) {
+  static char date_text[BLOCK_TEXT_LEN];
+
+  /* The date only has to be formatted again once a day */
+  if (clock_day_changed() || date_format_changed) {
+    date_format_changed = 0;
+    date_text[format_render(&date_format, NULL, clock_now(), date_text,
+                            sizeof(date_text) - 1)] = '\0';
+  }
+
+  memcpy(block->full_text, date_text, sizeof(date_text));
+}
+
+/* -----TIME----- */
+
+static void update_time(struct block *block) {
+  block->full_text[format_render(&time_format, NULL, clock_now(),
+                                 block->full_text,
+                                 sizeof(block->full_text) - 1)] = '\0';
+}
+
+struct module {
+  const char *name;
+  void (*update)(struct block *block);
+  void (*click)(int button);
+  uint32_t fields; // template fields this module provides
+  uint8_t signal;  // refresh on SIGRTMIN+signal, 0 for none
+  uint8_t clock;   // refresh on every wall clock second, not every interval
+  uint8_t events;  // refresh on its events only, after the first refresh
+};
+
+static const struct module modules[] = {
+    {.name = "volume",
+     .update = update_volume,
+     .click = click_volume,
+     .fields = FIELD_BIT(FIELD_VOL) | FIELD_BIT(FIELD_MIC),
+     .signal = 1},
+    {.name = "backlight",
+     .update = update_backlight,
+     .fields = FIELD_BIT(FIELD_BACKLIGHT),
+     .signal = 10,
+     .events = 1},
+    {.name = "battery",
+     .update = update_battery,
+     .fields = FIELD_BIT(FIELD_BAT) | FIELD_BIT(FIELD_BAT_TIME),
+     .signal = 2},
+    {.name = "network",
+     .update = update_network,
+     .fields = FIELD_BIT(FIELD_NET) | FIELD_BIT(FIELD_NET_DOWN) |
+               FIELD_BIT(FIELD_NET_UP) | FIELD_BIT(FIELD_NET_GRAPH) |
+               FIELD_BIT(FIELD_NET_PEAK) | FIELD_BIT(FIELD_NET_WIRED) |
+               FIELD_BIT(FIELD_NET_WIFI) | FIELD_BIT(FIELD_NET_VPN) |
+               FIELD_BIT(FIELD_WIFI_SSID) | FIELD_BIT(FIELD_WIFI_SIGNAL) |
+               FIELD_BIT(FIELD_WIFI_BITRATE),
+     .signal = 3},
+    {.name = "bluetooth",
+     .update = update_bluetooth,
+     .fields = FIELD_BIT(FIELD_BT),
+     .signal = 4},
+    {.name = "cpu",
+     .update = update_cpu,
+     .fields = FIELD_BIT(FIELD_CPU) | FIELD_BIT(FIELD_CPU_BARS),
+     .signal = 5},
+    {.name = "memory",
+     .update = update_memory,
+     .fields = FIELD_BIT(FIELD_MEM) | FIELD_BIT(FIELD_MEM_AVAIL) |
+               FIELD_BIT(FIELD_SWAP) | FIELD_BIT(FIELD_ZSWAP),
+     .signal = 6},
+    {.name = "thermal",
+     .update = update_thermal,
+     .fields = FIELD_BIT(FIELD_TEMP) | FIELD_BIT(FIELD_FAN),
+     .signal = 7},
+    {.name = "disk",
+     .update = update_disk,
+     .fields = FIELD_BIT(FIELD_DISK) | FIELD_BIT(FIELD_DISK_READ) |
+               FIELD_BIT(FIELD_DISK_WRITE) | FIELD_BIT(FIELD_DISKS),
+     .signal = 8},
+    {.name = "pressure",
+     .update = update_psi,
+     .fields = FIELD_BIT(FIELD_PSI),
+     .signal = 9},
+    {.name = "date",
+     .update = update_date,
+     .fields = FIELD_BIT(FIELD_DATE),
+     .clock = 1},
+    {.name = "time",
+     .update = update_time,
+     .fields = FIELD_BIT(FIELD_TIME),
+     .clock = 1},
+};
+
+#define MODULE_COUNT (sizeof(modules) / sizeof(modules[0]))
+
+enum ModuleIndex {
+  MOD_VOLUME,
+  MOD_BACKLIGHT,
+  MOD_BATTERY,
+  MOD_NETWORK,
+  MOD_BLUETOOTH,
+  MOD_CPU,
+  MOD_MEMORY,
+  MOD_THERMAL,
+  MOD_DISK,
+  MOD_PSI,
+  MOD_DATE,
+  MOD_TIME
+};
+
+static struct block blocks[MODULE_COUNT];
+static uint8_t enabled[MODULE_COUNT];
+
+/* The template ops, ops[first, end), that one i3bar block shows */
+struct segment {
+  uint8_t module;
+  uint16_t first;
+  uint16_t end;
+};
+
+static struct segment segments[FORMAT_MAX_OPS];
+static uint16_t segment_count = 0;
+static char frame[FRAME_BUFFER_LEN];
+
+/* Where each template field lives, and how much room there is */
+struct field_buffer {
+  char *text;
+  size_t size;
+};
+
+#define BLOCK_FIELD(module) {blocks[module].full_text, BLOCK_TEXT_LEN}
+#define VALUE_FIELD(buffer) {buffer, sizeof(buffer)}
+
+static const struct field_buffer field_buffers[FIELD_COUNT] = {
+    [FIELD_VOL] = BLOCK_FIELD(MOD_VOLUME),
+    [FIELD_MIC] = VALUE_FIELD(mic),
+    [FIELD_BACKLIGHT] = BLOCK_FIELD(MOD_BACKLIGHT),
+    [FIELD_BAT] = BLOCK_FIELD(MOD_BATTERY),
+    [FIELD_BAT_TIME] = VALUE_FIELD(battery_time),
+    [FIELD_NET] = BLOCK_FIELD(MOD_NETWORK),
+    [FIELD_NET_DOWN] = VALUE_FIELD(net_down),
+    [FIELD_NET_UP] = VALUE_FIELD(net_up),
+    [FIELD_NET_GRAPH] = VALUE_FIELD(net_graph),
+    [FIELD_NET_PEAK] = VALUE_FIELD(net_peak),
+    [FIELD_NET_WIRED] = VALUE_FIELD(net_class[NET_WIRED]),
+    [FIELD_NET_WIFI] = VALUE_FIELD(net_class[NET_WIRELESS]),
+    [FIELD_NET_VPN] = VALUE_FIELD(net_class[NET_TUNNEL]),
+    [FIELD_WIFI_SSID] = VALUE_FIELD(wifi_ssid),
+    [FIELD_WIFI_SIGNAL] = VALUE_FIELD(wifi_signal),
+    [FIELD_WIFI_BITRATE] = VALUE_FIELD(wifi_bitrate),
+    [FIELD_BT] = BLOCK_FIELD(MOD_BLUETOOTH),
+    [FIELD_CPU] = BLOCK_FIELD(MOD_CPU),
+    [FIELD_CPU_BARS] = VALUE_FIELD(cpu_bars),
+    [FIELD_MEM] = BLOCK_FIELD(MOD_MEMORY),
+    [FIELD_MEM_AVAIL] = VALUE_FIELD(mem_avail),
+    [FIELD_SWAP] = VALUE_FIELD(swap),
+    [FIELD_ZSWAP] = VALUE_FIELD(zswap),
+    [FIELD_TEMP] = BLOCK_FIELD(MOD_THERMAL),
+    [FIELD_FAN] = VALUE_FIELD(fan),
+    [FIELD_DISK] = BLOCK_FIELD(MOD_DISK),
+    [FIELD_DISK_READ] = VALUE_FIELD(disk_read),
+    [FIELD_DISK_WRITE] = VALUE_FIELD(disk_write),
+    [FIELD_DISKS] = VALUE_FIELD(disks),
+    [FIELD_PSI] = BLOCK_FIELD(MOD_PSI),
+};
+
+static const char *values[FIELD_COUNT];
+static uint32_t updated_modules; // since the last frame, for a recording
+static const char *budget_names[MODULE_COUNT + 1]; // and BUDGET_FRAME
+static uint32_t frame_calls; // system calls when the last frame ended
+static uint32_t refreshed_modules; // at least once before this frame
+static int8_t over_budget = 0;
+
+static int deadline = DEFAULT_DEADLINE_MS; // 0 for none
+static int module_deadlines[MODULE_COUNT]; // 0 for just the frame's
+static uint8_t backoff[MODULE_COUNT]; // intervals to skip after a miss
+static uint8_t skipped[MODULE_COUNT]; // intervals still to skip
+
+/* Put the last printed values of a module back, dimmed */
+static void show_last_values(size_t index) {
+  const struct field_buffer *field;
+  size_t f;
+
+  for (f = 0; f < FIELD_COUNT; f++) {
+    field = &field_buffers[f];
+    if ((modules[index].fields & FIELD_BIT(f)) && field->text) {
+      snprintf(field->text, field->size, "%s", snapshot_value(f));
+    }
+  }
+
+  blocks[index].color = COLOR_STALE;
+  blocks[index].urgent = 0;
+}
+
+/*
+ * A module that blew its deadline sits out 1, 2, 4 ... intervals, so a
+ * stalled backend stops holding up every frame. What it collected late is
+ * still shown, but one that gave up waiting shows its last good values.
+ * Signals and clicks still refresh it right away.
+ */
+static void missed_deadline(size_t index, int8_t gave_up) {
+  backoff[index] = backoff[index] == 0 ? 1 : backoff[index] * 2;
+  if (backoff[index] > BACKOFF_MAX_INTERVALS) {
+    backoff[index] = BACKOFF_MAX_INTERVALS;
+  }
+  skipped[index] = backoff[index];
+
+  if (gave_up) {
+    show_last_values(index);
+  }
+}
+
+/* Refresh a module; Pulse and D-Bus calls give up at `until`, 0 for never */
+static void refresh_module(size_t index, int64_t until) {
+  struct block *block = &blocks[index];
+  uint32_t calls = replay_calls();
+  int8_t gave_up;
+
+  block->full_text[0] = '\0';
+  block->instance[0] = '\0';
+  block->color = NULL;
+  block->urgent = 0;
+
+  clock_set_deadline(until);
+  trace_begin(modules[index].name);
+  modules[index].update(block);
+  trace_end(modules[index].name);
+  gave_up = clock_deadline_missed();
+  clock_set_deadline(0);
+
+  updated_modules |= 1U << index;
+  if (!budget_check(index, replay_calls() - calls)) {
+    over_budget = 1;
+  }
+
+  if (gave_up || (until && clock_monotonic_ms() > until)) {
+    missed_deadline(index, gave_up);
   } else {
-    printf("%s", NetworkIcons[IC_NT_DISABLED]); // Network disabled
+    backoff[index] = skipped[index] = 0;
+  }
+}
+
+/*
+ * When a refresh of module `index` starting now has to be done by: its own
+ * deadline if it has one, but never after `frame_end`, 0 for none.
+ */
+static int64_t module_until(size_t index, int64_t frame_end) {
+  int64_t until;
+
+  if (frame_end == 0 || module_deadlines[index] == 0) {
+    return frame_end;
+  }
+
+  until = clock_monotonic_ms() + module_deadlines[index];
+  return until < frame_end ? until : frame_end;
+}
+
+static void update_module(size_t index) {
+  int64_t frame_end = deadline ? clock_monotonic_ms() + deadline : 0;
+
+  refresh_module(index, module_until(index, frame_end));
+}
+
+/*
+ * All modules of a frame share one deadline, so the frame is out in time
+ * even when several are slow; modules left without time keep their last
+ * values until the next interval. A module with a deadline of its own gives
+ * up at that one, so a slow one cannot use up the time of those after it.
+ */
+static void update_modules(uint8_t clock) {
+  int64_t frame_end = deadline ? clock_monotonic_ms() + deadline : 0;
+  size_t i;
+
+  for (i = 0; i < MODULE_COUNT; i++) {
+    if (!enabled[i] || modules[i].clock != clock ||
+        (modules[i].events && (refreshed_modules & (1U << i)))) {
+      continue;
+    }
+
+    if (skipped[i] > 0) {
+      skipped[i]--;
+      continue;
+    }
+
+    if (frame_end && clock_monotonic_ms() >= frame_end) {
+      blocks[i].color = COLOR_STALE;
+      continue;
+    }
+
+    refresh_module(i, module_until(i, frame_end));
+  }
+}
+
+/* -----SNAPSHOT----- */
+
+/*
+ * Put the values of the last run back into the blocks so there is a frame to
+ * print before the first (possibly slow) collector returns. The clock is not
+ * restored; it is always cheap to compute.
+ */
+static int8_t restore_snapshot(void) {
+  size_t i;
+
+  if (!snapshot_open(FIELD_COUNT)) {
+    return 0;
+  }
+
+  for (i = 0; i < MODULE_COUNT; i++) {
+    if (!enabled[i] || modules[i].clock) {
+      continue;
+    }
+
+    show_last_values(i);
+  }
+
+  return 1;
+}
+
+static void save_snapshot(void) {
+  size_t f;
+
+  /* Replayed values are not this machine's */
+  if (replay_mode() == REPLAY_PLAYING) {
+    return;
+  }
+
+  for (f = 0; f < FIELD_COUNT; f++) {
+    if (field_buffers[f].text) {
+      snapshot_store(f, field_buffers[f].text);
+    }
+  }
+}
+
+static void update_all(void) {
+  update_modules(0);
+  update_modules(1);
+}
+
+static void write_frame(const char *buf, size_t len) {
+  ssize_t written;
+
+  trace_begin("write");
+  while (len > 0) {
+    if ((written = write(STDOUT_FILENO, buf, len)) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("write() failed!");
+      exit(1);
+    }
+    buf += written;
+    len -= written;
+  }
+  trace_end("write");
+}
+
+enum Output { OUT_TEXT, OUT_I3BAR, OUT_X11_ROOT };
+
+static enum Output output = OUT_TEXT;
+static int interval = DEFAULT_INTERVAL_SECONDS;
+
+/* Render the template into `frame` and return the length, without a newline */
+static size_t render_text(void) {
+  size_t len;
+
+  trace_begin("render");
+  len = format_render(&format, values, clock_now(), frame, sizeof(frame) - 1);
+  trace_end("render");
+
+  return len;
+}
+
+static void print_text(void) {
+  size_t len = render_text();
+
+  frame[len++] = '\n';
+  write_frame(frame, len);
+}
+
+static void print_x11_root(void) {
+  size_t len = render_text();
+
+  trace_begin("write");
+  x11_root_set_name(frame, len);
+  trace_end("write");
+}
+
+static size_t field_module(uint8_t field) {
+  size_t i;
+
+  for (i = 0; i < MODULE_COUNT; i++) {
+    if (modules[i].fields & FIELD_BIT(field)) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+/*
+ * Split the template into i3bar blocks, in template order. A block is a run
+ * of one module's fields with the text between them, so "{bat} {bat_time}"
+ * is the battery block; text between two modules is left out, as i3bar draws
+ * its own separators.
+ */
+static void find_segments(void) {
+  const struct format_op *op;
+  struct segment *last;
+  uint16_t i;
+  size_t module;
+
+  segment_count = 0;
+  for (i = 0; i < format.count; i++) {
+    op = &format.ops[i];
+    /* Only the text of a {date} or {time} spec is marked with its field */
+    if (op->type == OP_LITERAL && op->field != FIELD_DATE &&
+        op->field != FIELD_TIME) {
+      continue;
+    }
+
+    module = field_module(op->field);
+    last = segment_count > 0 ? &segments[segment_count - 1] : NULL;
+    if (last && last->module == module) {
+      last->end = i + 1;
+      continue;
+    }
+
+    segments[segment_count].module = module;
+    segments[segment_count].first = i;
+    segments[segment_count++].end = i + 1;
+  }
+}
+
+static void print_i3bar(void) {
+  struct json_writer writer;
+  const struct segment *segment;
+  const struct tm *tm = clock_now();
+  struct block block;
+  size_t i, len;
+
+  trace_begin("render");
+  json_init(&writer, frame, sizeof(frame));
+  i3bar_begin_frame(&writer);
+
+  for (i = 0; i < segment_count; i++) {
+    segment = &segments[i];
+    block = blocks[segment->module];
+    len = format_render_span(&format, segment->first, segment->end, values, tm,
+                             block.full_text, sizeof(block.full_text) - 1);
+    block.full_text[len] = '\0';
+    i3bar_block(&writer, modules[segment->module].name, &block);
+  }
+
+  i3bar_end_frame(&writer);
+  trace_end("render");
+
+  if (writer.overflow) {
+    fprintf(stderr, "frame does not fit in %d bytes!\n", FRAME_BUFFER_LEN);
+    return;
+  }
+
+  write_frame(frame, writer.len);
+}
+
+/*
+ * A recording notes which modules each frame was updated from. A frame's
+ * budget covers its refreshes and writing it out, unless one of them was the
+ * first refresh of a module, which opens its files.
+ */
+static void end_frame(void) {
+  if (replay_mode() == REPLAY_RECORDING) {
+    replay_frame(updated_modules);
+  }
+
+  if ((updated_modules & ~refreshed_modules) == 0 &&
+      !budget_check(MODULE_COUNT, replay_calls() - frame_calls)) {
+    over_budget = 1;
+  }
+  frame_calls = replay_calls();
+  refreshed_modules |= updated_modules;
+  updated_modules = 0;
+  trace_flush();
+}
+
+static void print_output(void) {
+  switch (output) {
+  case OUT_TEXT:
+    print_text();
+    break;
+  case OUT_I3BAR:
+    print_i3bar();
+    break;
+  case OUT_X11_ROOT:
+    print_x11_root();
+    break;
+  }
+
+  end_frame();
+  save_snapshot();
+}
+
+static void handle_click(const struct click_event *event) {
+  size_t i;
+
+  for (i = 0; i < MODULE_COUNT; i++) {
+    if (strcmp(modules[i].name, event->name) != 0) {
+      continue;
+    }
+
+    if (enabled[i] && modules[i].click) {
+      modules[i].click(event->button);
+      update_module(i);
+      print_output();
+    }
+    return;
+  }
+}
+
+/*
+ * dwmblocks style realtime signals: `pkill -RTMIN+n status` refreshes only the
+ * modules mapped to n. The signals are blocked and read from a signalfd so
+ * they are handled in the loop like any other event; signals of modules left
+ * out of the template are swallowed rather than killing us.
+ */
+static int open_signalfd(void) {
+  sigset_t mask;
+  size_t i;
+  int fd;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGHUP); // reload the config file
+
+  for (i = 0; i < MODULE_COUNT; i++) {
+    if (!modules[i].signal) {
+      continue;
+    }
+    if (SIGRTMIN + modules[i].signal > SIGRTMAX) {
+      fprintf(stderr, "signal RTMIN+%d out of range!\n", modules[i].signal);
+      exit(1);
+    }
+    sigaddset(&mask, SIGRTMIN + modules[i].signal);
+  }
+
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+    perror("sigprocmask() failed!");
+    exit(1);
+  }
+
+  if ((fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+    perror("signalfd() failed!");
+    exit(1);
+  }
+
+  return fd;
+}
+
+/* Returns whether a SIGHUP asked for the config to be reloaded */
+static int8_t handle_signals(int fd) {
+  struct signalfd_siginfo info;
+  uint8_t refreshed = 0;
+  int8_t reload = 0;
+  size_t i;
+
+  while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+    if (info.ssi_signo == SIGHUP) {
+      reload = 1;
+      continue;
+    }
+
+    for (i = 0; i < MODULE_COUNT; i++) {
+      if (enabled[i] && modules[i].signal &&
+          (int)info.ssi_signo == SIGRTMIN + modules[i].signal) {
+        update_module(i);
+        refreshed = 1;
+      }
+    }
+  }
+
+  if (refreshed) {
+    print_output();
+  }
+
+  return reload;
+}
+
+/* Subsystems whose uevents refresh a module, bit i for entry i */
+static const char *const UeventSubsystems[] = {HWMON_SUBSYSTEM,
+                                               BACKLIGHT_SUBSYSTEM};
+
+enum UeventSubsystem { UEVENT_HWMON, UEVENT_BACKLIGHT, UEVENT_COUNT };
+
+static void handle_uevents(int fd) {
+  uint32_t changed;
+  uint32_t hotplugged =
+      uevent_read(fd, UeventSubsystems, UEVENT_COUNT, &changed);
+  uint32_t subsystems = hotplugged | changed;
+
+  /* Sensors are only looked up again when an hwmon chip comes or goes */
+  if ((hotplugged & (1U << UEVENT_HWMON)) && enabled[MOD_THERMAL]) {
+    thermal_invalidate();
+    update_module(MOD_THERMAL);
+    print_output();
+  }
+
+  /*
+   * Brightness keys and writes to the brightness file both send one; only a
+   * backlight that comes or goes has the search run again
+   */
+  if ((subsystems & (1U << UEVENT_BACKLIGHT)) && enabled[MOD_BACKLIGHT]) {
+    if (hotplugged & (1U << UEVENT_BACKLIGHT)) {
+      backlight_invalidate();
+    }
+    update_module(MOD_BACKLIGHT);
+    print_output();
+  }
+}
+
+enum PollFd {
+  POLL_STDIN,
+  POLL_SIGNAL,
+  POLL_TIMER,
+  POLL_UEVENT,
+  POLL_CONFIG,
+  POLL_ZONE, // changes to /etc/localtime
+  POLL_WIFI,
+  POLL_DBUS, // logind signals
+  POLL_PSI, // one per PsiResource
+  POLL_COUNT = POLL_PSI + PSI_COUNT
+};
+
+/* Whether the clock output changes every second or only every minute */
+static int8_t clock_shows_seconds(void) {
+  if (enabled[MOD_TIME] && format_has_seconds(&time_format)) {
+    return 1;
+  }
+
+  /* Clock specs the blocks do not show are still formatted by text frames */
+  return output != OUT_I3BAR && format_has_seconds(&format);
+}
+
+static int8_t clock_needed(void) {
+  size_t i;
+
+  for (i = 0; i < MODULE_COUNT; i++) {
+    if (enabled[i] && modules[i].clock) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Every refresh hangs off one wall clock aligned timer, so there is at most
+ * one wakeup per timer period. The period is the refresh interval, stretched
+ * on battery and while the session is idle, but when the clock is shown it
+ * is cut down to a divisor of 60 (1 when seconds are shown) so minute
+ * boundaries still land on a tick. The interval modules then run every
+ * `interval_ticks` ticks.
+ */
+static int timer_period = 1;
+static int interval_ticks = 1;
+
+static void schedule(int timer_fd) {
+  static const int divisors_of_60[] = {60, 30, 20, 15, 12, 10, 6, 5, 4, 3, 2};
+  int effective = interval * power_interval_scale();
+  size_t i;
+
+  timer_period = effective;
+
+  if (clock_shows_seconds()) {
+    timer_period = 1;
+  } else if (clock_needed()) {
+    timer_period = 1;
+    for (i = 0; i < sizeof(divisors_of_60) / sizeof(divisors_of_60[0]); i++) {
+      if (divisors_of_60[i] <= effective) {
+        timer_period = divisors_of_60[i];
+        break;
+      }
+    }
+  }
+
+  interval_ticks = (effective + timer_period - 1) / timer_period;
+  clock_set_period(timer_fd, timer_period);
+}
+
+/* -----CONFIG----- */
+
+static struct config config;    // in effect
+static struct config overrides; // from the command line
+
+static void config_defaults(struct config *next) {
+  if (next->deadline <= 0) {
+    next->deadline = DEFAULT_DEADLINE_MS;
+  }
+  if (next->format[0] == '\0') {
+    strcpy(next->format, DEFAULT_FORMAT);
   }
+  if (next->interval <= 0) {
+    next->interval = DEFAULT_INTERVAL_SECONDS;
+  }
+}
 
-  printf(SEPARATOR_SYMBOL);
+/*
+ * Swap in a new configuration between two frames. Only what changed is
+ * redone: sensors, disks and interfaces are looked up again when their
+ * selection changed, sinks are classified again for new headphone words,
+ * and modules the new format mentions for the first time are collected when
+ * `collect` is set. Every other module keeps its state (Pulse context,
+ * D-Bus cache, counter history).
+ */
+static int8_t apply_config(const struct config *next, int8_t collect) {
+  int deadlines[MODULE_COUNT] = {0};
+  struct format compiled;
+  uint8_t was_enabled;
+  size_t error_offset, i, d;
 
-  /* -----BLUETOOTH----- */
+  if (!format_compile(next->format, &compiled, &error_offset)) {
+    fprintf(stderr, "invalid format at offset %zu: %s\n", error_offset,
+            next->format);
+    return 0;
+  }
+
+  for (d = 0; d < next->deadline_count; d++) {
+    for (i = 0; i < MODULE_COUNT &&
+                strcmp(modules[i].name, next->deadlines[d].module) != 0;
+         i++)
+      ;
+    if (i == MODULE_COUNT) {
+      fprintf(stderr, "unknown module in %s%s\n", CONFIG_DEADLINE_KEY,
+              next->deadlines[d].module);
+      return 0;
+    }
+    deadlines[i] = next->deadlines[d].deadline;
+  }
 
-  if (bluetooth_is_blocked()) {
-    printf("%s", BluetoothIcons[IC_BT_DISABLED]); // Bluetooth disabled
+  if (strcmp(next->sensors, config.sensors) != 0) {
+    thermal_select(next->sensors);
+    thermal_invalidate();
+  }
+  if (strcmp(next->disks, config.disks) != 0) {
+    disk_select(next->disks);
+    disk_invalidate();
+  }
+  if (strcmp(next->interfaces, config.interfaces) != 0) {
+    network_select(next->interfaces);
+    network_invalidate();
+  }
+  if (strcmp(next->headphones, config.headphones) != 0) {
+    volume_select_headphones(next->headphones);
+  }
 
+  format = compiled;
+  format_clock(&format, FIELD_DATE, &date_format);
+  format_clock(&format, FIELD_TIME, &time_format);
+  format_share_clock(&format, FIELD_DATE, &date_format);
+  format_share_clock(&format, FIELD_TIME, &time_format);
+  find_segments();
+  date_format_changed = 1;
+  interval = next->interval;
+  deadline = next->deadline;
+  memcpy(module_deadlines, deadlines, sizeof(module_deadlines));
+  config = *next;
+
+  /* Modules the template never mentions are never collected */
+  for (i = 0; i < MODULE_COUNT; i++) {
+    was_enabled = enabled[i];
+    enabled[i] = (format.fields & modules[i].fields) != 0;
+
+    if (collect && enabled[i] && !was_enabled) {
+      update_module(i);
+    }
+  }
+
+  return 1;
+}
+
+/* Event sources only some modules need; opened again after a reload */
+static void open_module_sources(struct pollfd *fds) {
+  size_t i;
+
+  if ((enabled[MOD_THERMAL] || enabled[MOD_BACKLIGHT]) &&
+      fds[POLL_UEVENT].fd == -1) {
+    fds[POLL_UEVENT].fd = uevent_open();
+  }
+
+  /* nl80211 tells about connects and roams right away */
+  if (enabled[MOD_NETWORK] && fds[POLL_WIFI].fd == -1) {
+    fds[POLL_WIFI].fd = wifi_events_open();
+  }
+
+  /* PSI triggers signal a crossed threshold as POLLPRI */
+  if (enabled[MOD_PSI]) {
+    psi_open();
+    for (i = 0; i < PSI_COUNT; i++) {
+      fds[POLL_PSI + i].fd = psi_trigger_fd(i);
+    }
+  }
+}
+
+/* A broken config file leaves the running configuration alone */
+static void reload_config(struct pollfd *fds) {
+  struct config next;
+
+  if (!config_load(&next)) {
+    fprintf(stderr, "keeping the current configuration\n");
+    return;
+  }
+  config_merge(&next, &overrides);
+  config_defaults(&next);
+
+  if (!apply_config(&next, 1)) {
+    return;
+  }
+
+  open_module_sources(fds);
+  schedule(fds[POLL_TIMER].fd);
+  print_output();
+}
+
+/* Refresh until killed; only i3bar sends us click events */
+static void run(int8_t stats) {
+  struct pollfd fds[POLL_COUNT];
+  int64_t stats_since = clock_monotonic_ms(), now;
+  int ticks = 0, wakeups = 0;
+  size_t i;
+
+  power_set_timer_slack();
+
+  /* poll() skips negative descriptors, so closed sources are set to -1 */
+  fds[POLL_STDIN].fd = output == OUT_I3BAR ? STDIN_FILENO : -1;
+  fds[POLL_SIGNAL].fd = open_signalfd();
+  fds[POLL_TIMER].fd = clock_open(timer_period);
+  fds[POLL_UEVENT].fd = -1;
+  fds[POLL_CONFIG].fd = config_watch();
+  fds[POLL_ZONE].fd = clock_zone_watch();
+  fds[POLL_WIFI].fd = -1;
+
+  /* Reading the session hints must not hold up the first frame for long */
+  clock_set_deadline(clock_monotonic_ms() + deadline);
+  fds[POLL_DBUS].fd = power_watch();
+  clock_set_deadline(0);
+
+  for (i = 0; i < POLL_COUNT; i++) {
+    fds[i].events = POLLIN;
+  }
+
+  for (i = 0; i < PSI_COUNT; i++) {
+    fds[POLL_PSI + i].fd = -1;
+    fds[POLL_PSI + i].events = POLLPRI;
+  }
+
+  open_module_sources(fds);
+
+  if (output == OUT_I3BAR) {
+    write_frame(I3BAR_HEADER, strlen(I3BAR_HEADER));
+  }
+
+  if (restore_snapshot()) {
+    update_modules(1);
+    print_output();
+
+    /* Live values replace the stale ones as each collector returns */
+    for (i = 0; i < MODULE_COUNT; i++) {
+      if (enabled[i] && !modules[i].clock) {
+        update_module(i);
+        print_output();
+      }
+    }
   } else {
+    update_all();
+    print_output();
+  }
+  schedule(fds[POLL_TIMER].fd);
 
-    if (bluetooth_is_connected()) {
-      get_connected_bluetooth_device_name(bluetooth_device_name);
-
-      char *battery_info = get_connected_bluetooth_device_battery();
-
-      if (bluetooth_device_name[0] != '\0') {
-        if (battery_info[0] != '\0') {
-          printf("%s %s (%s)", BluetoothIcons[IC_BT_CONNECTED],
-                 bluetooth_device_name, battery_info);
-        } else {
-          printf("%s %s", BluetoothIcons[IC_BT_CONNECTED],
-                 bluetooth_device_name);
-        }
-      } else {
-        printf("%s", BluetoothIcons[IC_BT_CONNECTED]);
+  while (1) {
+    if (poll(fds, POLL_COUNT, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("poll() failed!");
+      exit(1);
+    }
+
+    wakeups++;
+
+    if ((fds[POLL_TIMER].revents & POLLIN) && clock_read(fds[POLL_TIMER].fd)) {
+      if (++ticks >= interval_ticks) {
+        ticks = 0;
+        update_modules(0);
+        schedule(fds[POLL_TIMER].fd);
+      }
+      update_modules(1);
+      print_output();
+    }
+
+    if ((fds[POLL_SIGNAL].revents & POLLIN) &&
+        handle_signals(fds[POLL_SIGNAL].fd)) {
+      reload_config(fds);
+    }
+
+    if ((fds[POLL_CONFIG].revents & POLLIN) &&
+        config_changed(fds[POLL_CONFIG].fd)) {
+      reload_config(fds);
+    }
+
+    if ((fds[POLL_ZONE].revents & POLLIN) &&
+        clock_zone_read(fds[POLL_ZONE].fd) && clock_needed()) {
+      update_modules(1);
+      print_output();
+    }
+
+    if (fds[POLL_UEVENT].revents & POLLIN) {
+      handle_uevents(fds[POLL_UEVENT].fd);
+    }
+
+    if ((fds[POLL_WIFI].revents & POLLIN) &&
+        wifi_events_read(fds[POLL_WIFI].fd) && enabled[MOD_NETWORK]) {
+      update_module(MOD_NETWORK);
+      print_output();
+    }
+
+    /* A locked or idle session stretches the interval right away */
+    if (fds[POLL_DBUS].revents & (POLLERR | POLLHUP)) {
+      fds[POLL_DBUS].fd = -1;
+    } else if ((fds[POLL_DBUS].revents & POLLIN) && power_dispatch()) {
+      schedule(fds[POLL_TIMER].fd);
+    }
+
+    for (i = 0; i < PSI_COUNT; i++) {
+      if (fds[POLL_PSI + i].revents & POLLERR) {
+        fds[POLL_PSI + i].fd = -1;
+      } else if ((fds[POLL_PSI + i].revents & POLLPRI) && enabled[MOD_PSI]) {
+        psi_triggered(i);
+        update_module(MOD_PSI);
+        print_output();
+      }
+    }
+
+    if (fds[POLL_STDIN].revents & (POLLIN | POLLHUP)) {
+      if (!i3bar_read_clicks(STDIN_FILENO, handle_click)) {
+        fds[POLL_STDIN].fd = -1;
+      }
+    }
+
+    if (stats && (now = clock_monotonic_ms()) - stats_since >= 60000) {
+      fprintf(stderr,
+              "wakeups/min: %.1f (period %ds, interval every %d), "
+              "arena: %zu bytes\n",
+              wakeups * 60000.0 / (now - stats_since), timer_period,
+              interval_ticks, arena_used());
+      stats_since = now;
+      wakeups = 0;
+    }
+  }
+}
+
+/* -----REPLAY----- */
+
+static int8_t replay_config(struct config *loaded) {
+  const void *data;
+  size_t len;
+  int status;
+
+  data = replay_next(REPLAY_VALUE, CONFIG_REPLAY_KEY, &len, &status);
+  if (data == NULL || len > sizeof(*loaded)) {
+    fprintf(stderr, "the recording holds no configuration!\n");
+    return 0;
+  }
+
+  /* New settings go at the end, so older recordings leave them unset */
+  memset(loaded, 0, sizeof(*loaded));
+  memcpy(loaded, data, len);
+  return 1;
+}
+
+/*
+ * Print every frame of a recording as fast as the collectors go, updating
+ * the modules each frame was updated from. Only the inputs of the
+ * collectors are replayed; the clock shows the current time.
+ */
+static void run_replay(void) {
+  uint32_t frames = replay_frames(), n, updated;
+  int64_t start = clock_monotonic_ms(), elapsed;
+  size_t i;
+
+  if (output == OUT_I3BAR) {
+    write_frame(I3BAR_HEADER, strlen(I3BAR_HEADER));
+  }
+
+  for (n = 0; n < frames; n++) {
+    updated = replay_frame(0);
+    for (i = 0; i < MODULE_COUNT; i++) {
+      if (enabled[i] && (updated & (1U << i))) {
+        update_module(i);
+      }
+    }
+    print_output();
+  }
+
+  elapsed = clock_monotonic_ms() - start;
+  fprintf(stderr, "%u frames in %lld ms (%.0f frames/s)\n", frames,
+          (long long)elapsed, elapsed > 0 ? frames * 1000.0 / elapsed : 0.0);
+  exit(over_budget);
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--i3bar | --x11-root] [--config FILE] "
+          "[--format TEMPLATE] "
+          "[--interval SECONDS] [--deadline MS] [--sensors LABELS] "
+          "[--disks NAMES] [--interfaces PATTERNS] [--headphones WORDS] "
+          "[--stats] [--budget FILE] [--trace FILE] "
+          "[--record FILE | --replay FILE]\n",
+          program);
+  exit(1);
+}
+
+/* Copy an option value into a config field, rejecting what does not fit */
+static void set_option(char *dst, size_t size, const char *value,
+                       const char *program) {
+  if (strlen(value) >= size) {
+    usage(program);
+  }
+  strcpy(dst, value);
+}
+
+int main(int argc, char *argv[]) {
+  const char *budget_path = NULL;
+  struct config loaded;
+  int8_t stats = 0;
+  size_t i;
+
+  for (i = 1; i < (size_t)argc; i++) {
+    if (strcmp(argv[i], "--i3bar") == 0) {
+      output = OUT_I3BAR;
+    } else if (strcmp(argv[i], "--x11-root") == 0) {
+      output = OUT_X11_ROOT;
+    } else if (strcmp(argv[i], "--config") == 0 && i + 1 < (size_t)argc) {
+      config_set_path(argv[++i]);
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < (size_t)argc) {
+      set_option(overrides.format, sizeof(overrides.format), argv[++i],
+                 argv[0]);
+    } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < (size_t)argc) {
+      if ((overrides.interval = atoi(argv[++i])) <= 0) {
+        usage(argv[0]);
+      }
+    } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < (size_t)argc) {
+      if ((overrides.deadline = atoi(argv[++i])) <= 0) {
+        usage(argv[0]);
+      }
+    } else if (strcmp(argv[i], "--sensors") == 0 && i + 1 < (size_t)argc) {
+      set_option(overrides.sensors, sizeof(overrides.sensors), argv[++i],
+                 argv[0]);
+    } else if (strcmp(argv[i], "--disks") == 0 && i + 1 < (size_t)argc) {
+      set_option(overrides.disks, sizeof(overrides.disks), argv[++i],
+                 argv[0]);
+    } else if (strcmp(argv[i], "--interfaces") == 0 &&
+               i + 1 < (size_t)argc) {
+      set_option(overrides.interfaces, sizeof(overrides.interfaces),
+                 argv[++i], argv[0]);
+    } else if (strcmp(argv[i], "--headphones") == 0 &&
+               i + 1 < (size_t)argc) {
+      set_option(overrides.headphones, sizeof(overrides.headphones),
+                 argv[++i], argv[0]);
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats = 1;
+    } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < (size_t)argc) {
+      budget_path = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < (size_t)argc) {
+      if (!trace_open(argv[++i])) {
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < (size_t)argc &&
+               replay_mode() == REPLAY_OFF) {
+      if (!replay_record(argv[++i])) {
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < (size_t)argc &&
+               replay_mode() == REPLAY_OFF) {
+      if (!replay_load(argv[++i])) {
+        exit(1);
       }
     } else {
-      printf("%s", BluetoothIcons[IC_BT_ENABLED]); // Enabled, not connected
+      usage(argv[0]);
     }
   }
 
-  printf(SEPARATOR_SYMBOL);
+  for (i = 0; i < FIELD_COUNT; i++) {
+    values[i] = field_buffers[i].text;
+  }
+  /* Not in field_buffers: the clock is never saved in a snapshot */
+  values[FIELD_DATE] = blocks[MOD_DATE].full_text;
+  values[FIELD_TIME] = blocks[MOD_TIME].full_text;
 
-  /* -----DATE----- */
+  for (i = 0; i < MODULE_COUNT; i++) {
+    budget_names[i] = modules[i].name;
+  }
+  budget_names[MODULE_COUNT] = BUDGET_FRAME;
 
-  printf("%s, %s %02d", days_of_week[tm.tm_wday], months_of_year[tm.tm_mon],
-         tm.tm_mday);
+  if (budget_path &&
+      !budget_load(budget_path, budget_names, MODULE_COUNT + 1)) {
+    exit(1);
+  }
+  if (budget_path && !replay_counting()) {
+    fprintf(stderr, "--budget counts system calls under "
+                    "LD_PRELOAD=./syscall_count.so, in recordings made "
+                    "under it too\n");
+    exit(1);
+  }
 
-  printf(SEPARATOR_SYMBOL);
+  /* A replay runs with the configuration it was recorded with */
+  if (replay_mode() == REPLAY_PLAYING) {
+    if (!replay_config(&loaded)) {
+      exit(1);
+    }
+  } else if (!config_load(&loaded)) {
+    exit(1);
+  }
+  config_merge(&loaded, &overrides);
+  config_defaults(&loaded);
+  replay_capture(REPLAY_VALUE, CONFIG_REPLAY_KEY, &loaded, sizeof(loaded), 0,
+                 replay_calls());
 
-  /* -----TIME----- */
+  if (!apply_config(&loaded, 0)) {
+    exit(1);
+  }
 
-  printf("%02d:%02d:%02d\n", tm.tm_hour, tm.tm_min, tm.tm_sec);
+  if (output == OUT_X11_ROOT && !x11_root_open()) {
+    exit(1);
+  }
 
-  return 0;
+  if (replay_mode() == REPLAY_PLAYING) {
+    run_replay();
+  }
+
+  if (output != OUT_TEXT) {
+    run(stats);
+  }
+
+  /* Nothing comes after the one line, so it waits for every collector */
+  deadline = 0;
+  update_all();
+  print_text();
+  end_frame();
+
+  return over_budget;
 }
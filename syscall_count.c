@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * LD_PRELOAD shim for `--budget` and `--record`: a forked tracer stops status
+ * at the entry of every system call, its own and those libc, libpulse and
+ * libdbus make for it, and counts them in a page both share. status finds
+ * syscall_count() when it is loaded; without it nothing is counted.
+ */
+
+static volatile uint32_t *counter;
+
+uint32_t syscall_count(void) { return *counter; }
+
+static void fail(const char *message) {
+  write(STDERR_FILENO, message, strlen(message));
+  _exit(1);
+}
+
+/* Runs in the child until status exits; status is a single thread */
+static void trace(pid_t tracee, int ready) {
+  struct __ptrace_syscall_info info;
+  sigset_t all;
+  int status, deliver;
+
+  /* `pkill status` and the terminal's signals are meant for status */
+  sigfillset(&all);
+  sigprocmask(SIG_BLOCK, &all, NULL);
+  prctl(PR_SET_NAME, "syscall-count");
+
+  if (ptrace(PTRACE_SEIZE, tracee, NULL,
+             PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL) == -1 ||
+      ptrace(PTRACE_INTERRUPT, tracee, NULL, 0) == -1) {
+    _exit(1);
+  }
+  write(ready, "", 1);
+
+  while (waitpid(tracee, &status, __WALL) == tracee) {
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      break;
+    }
+
+    deliver = 0;
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      if (ptrace(PTRACE_GET_SYSCALL_INFO, tracee, sizeof(info), &info) > 0 &&
+          info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+        (*counter)++;
+      }
+    } else if (status >> 16 == 0) {
+      deliver = WSTOPSIG(status); // a signal on its way to status
+    }
+
+    ptrace(PTRACE_SYSCALL, tracee, NULL, deliver);
+  }
+
+  _exit(0);
+}
+
+__attribute__((constructor)) static void start(void) {
+  pid_t tracee = getpid(), tracer;
+  int ready[2];
+  char byte;
+
+  counter = mmap(NULL, sizeof(*counter), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (counter == MAP_FAILED || pipe(ready) == -1) {
+    fail("syscall-count: no shared counter\n");
+  }
+
+  /* Yama only lets ancestors trace, unless the tracee says otherwise */
+  prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY);
+
+  if ((tracer = fork()) == -1) {
+    fail("syscall-count: fork() failed\n");
+  }
+  if (tracer == 0) {
+    close(ready[0]);
+    trace(tracee, ready[1]);
+  }
+
+  close(ready[1]);
+  if (read(ready[0], &byte, 1) != 1) {
+    fail("syscall-count: cannot trace status\n");
+  }
+  close(ready[0]);
+  prctl(PR_SET_PTRACER, 0);
+}
@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+
+#include "replay.h"
+#include "sysfs.h"
+#include "trace.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Small sysfs helpers that never touch the heap: no FILE buffers, no DIR
+ * streams. Collectors keep the descriptors they read every tick open and
+ * pread() them from offset 0, which makes sysfs regenerate the value.
+ */
+
+/* The names a recorded scan of `dir` saw */
+static int8_t replay_scan_dir(const char *dir,
+                              int8_t (*match)(const char *name, void *data),
+                              void *data) {
+  const char *names, *name;
+  size_t len;
+  int status;
+
+  if ((names = replay_next(REPLAY_DIR, dir, &len, &status)) == NULL) {
+    return 0;
+  }
+
+  for (name = names; name < names + len; name += strlen(name) + 1) {
+    if (match(name, data)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Open dir + name + file, e.g. POWER_SUPPLY_DIR, "BAT0", BAT_STATUS_FILE */
+int sysfs_open(const char *dir, const char *name, const char *file) {
+  char path[PATH_MAX];
+
+  if ((size_t)snprintf(path, sizeof(path), "%s%s%s", dir, name, file) >=
+      sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return replay_open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/* Read the whole (short) value, NUL terminated and without the newline */
+int8_t sysfs_pread(int fd, char *buf, size_t len) {
+  ssize_t count = -1;
+
+  trace_begin("sysfs read");
+  if (fd >= 0) {
+    count = replay_pread(fd, buf, len - 1);
+  }
+  trace_end("sysfs read");
+
+  if (count < 0) {
+    return 0;
+  }
+
+  while (count > 0 && (buf[count - 1] == '\n' || buf[count - 1] == ' ')) {
+    count--;
+  }
+  buf[count] = '\0';
+
+  return 1;
+}
+
+int8_t sysfs_pread_int(int fd, int64_t *value) {
+  char buf[SYSFS_VALUE_LEN];
+  char *end;
+
+  if (!sysfs_pread(fd, buf, sizeof(buf))) {
+    return 0;
+  }
+
+  *value = strtoll(buf, &end, 10);
+
+  return end != buf;
+}
+
+/* One-off read of a file that is not worth keeping open */
+int8_t sysfs_read(const char *dir, const char *name, const char *file,
+                  char *buf, size_t len) {
+  int fd;
+  int8_t found;
+
+  if ((fd = sysfs_open(dir, name, file)) == -1) {
+    return 0;
+  }
+
+  found = sysfs_pread(fd, buf, len);
+  replay_close(fd);
+
+  return found;
+}
+
+/*
+ * Call `match` for every entry of `dir` except dot files until it returns
+ * non-zero. Returns whether an entry matched; a missing directory is not an
+ * error.
+ */
+static int8_t scan_dir(const char *dir,
+                       int8_t (*match)(const char *name, void *data),
+                       void *data) {
+  char buffer[SYSFS_DIR_BUFFER_LEN];
+  char seen[SYSFS_DIR_BUFFER_LEN]; // names handed to `match`, for --record
+  size_t seen_len = 0, name_len;
+  struct dirent64 *entry;
+  ssize_t count, offset;
+  uint32_t since = replay_calls(), before;
+  int8_t found = 0;
+  int fd;
+
+  if (replay_mode() == REPLAY_PLAYING) {
+    return replay_scan_dir(dir, match, data);
+  }
+
+  if ((fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+    if (errno != ENOENT) {
+      perror("open() failed!");
+    }
+    return 0;
+  }
+
+  while (!found && (count = getdents64(fd, buffer, sizeof(buffer))) > 0) {
+    for (offset = 0; offset < count; offset += entry->d_reclen) {
+      entry = (struct dirent64 *)(buffer + offset);
+
+      if (entry->d_name[0] == '.') {
+        continue;
+      }
+
+      name_len = strlen(entry->d_name) + 1;
+      if (name_len <= sizeof(seen) - seen_len) {
+        memcpy(seen + seen_len, entry->d_name, name_len);
+        seen_len += name_len;
+      }
+
+      /* What `match` reads is recorded, and charged, on its own */
+      before = replay_calls();
+      found = match(entry->d_name, data);
+      since += replay_calls() - before;
+      if (found) {
+        break;
+      }
+    }
+  }
+
+  if (count == -1) {
+    perror("getdents64() failed!");
+  }
+
+  close(fd);
+  replay_capture(REPLAY_DIR, dir, seen, seen_len, 0, since);
+
+  return found;
+}
+
+int8_t sysfs_scan_dir(const char *dir,
+                      int8_t (*match)(const char *name, void *data),
+                      void *data) {
+  int8_t found;
+
+  trace_begin("sysfs scan");
+  found = scan_dir(dir, match, data);
+  trace_end("sysfs scan");
+
+  return found;
+}
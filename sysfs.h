@@ -0,0 +1,19 @@
+#ifndef SYSFS_H
+#define SYSFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYSFS_VALUE_LEN 64
+#define SYSFS_DIR_BUFFER_LEN 4096
+
+int sysfs_open(const char *dir, const char *name, const char *file);
+int8_t sysfs_pread(int fd, char *buf, size_t len);
+int8_t sysfs_pread_int(int fd, int64_t *value);
+int8_t sysfs_read(const char *dir, const char *name, const char *file,
+                  char *buf, size_t len);
+int8_t sysfs_scan_dir(const char *dir,
+                      int8_t (*match)(const char *name, void *data),
+                      void *data);
+
+#endif // SYSFS_H
@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "replay.h"
+#include "thermal.h"
+#include "sysfs.h"
+
+#include <errno.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * hwmon chips are looked up once and the temp*_input / fan*_input files of
+ * the chosen sensors stay open, so a sample is one pread() per sensor. The
+ * lookup is only repeated after thermal_invalidate(), which the caller does
+ * on hwmon hotplug events, or when a sensor went away under us.
+ */
+
+/* Chips watched when the user did not pick sensors by label */
+static const char *default_chips[] = {"coretemp", "k10temp", "nvme", "acpitz"};
+
+#define DEFAULT_CHIP_COUNT (sizeof(default_chips) / sizeof(default_chips[0]))
+
+struct sensor {
+  int fd;
+  uint8_t fan;
+};
+
+/* The hwmon directory being scanned */
+struct chip_scan {
+  const char *name; // hwmonN
+  char chip[THERMAL_LABEL_LEN];
+  char dir[PATH_MAX];
+};
+
+static char selection[THERMAL_SELECTION_LEN];
+static const char *selectors[THERMAL_MAX_SELECTORS];
+static uint8_t selector_count = 0;
+
+static struct sensor sensors[THERMAL_MAX_SENSORS];
+static uint8_t sensor_count = 0;
+static int8_t discovered = 0;
+
+static int32_t max_temp, max_fan;
+static int8_t has_temp, has_fan;
+
+/* Comma separated chip names or sensor labels, e.g. "Tctl,Composite" */
+void thermal_select(const char *labels) {
+  char *label;
+
+  strncpy(selection, labels, sizeof(selection) - 1);
+  label = strtok(selection, ",");
+
+  selector_count = 0;
+
+  while (label && selector_count < THERMAL_MAX_SELECTORS) {
+    selectors[selector_count++] = label;
+    label = strtok(NULL, ",");
+  }
+}
+
+void thermal_invalidate(void) {
+  uint8_t i;
+
+  for (i = 0; i < sensor_count; i++) {
+    replay_close(sensors[i].fd);
+  }
+
+  sensor_count = 0;
+  discovered = 0;
+}
+
+static int8_t is_selected(const char *chip, const char *label, uint8_t fan) {
+  size_t i;
+
+  if (selector_count == 0) {
+    /* Fans are rare enough that all of them are interesting */
+    if (fan) {
+      return 1;
+    }
+
+    for (i = 0; i < DEFAULT_CHIP_COUNT; i++) {
+      if (strcmp(chip, default_chips[i]) == 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  for (i = 0; i < selector_count; i++) {
+    if (strcmp(selectors[i], chip) == 0 || strcmp(selectors[i], label) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Matches tempN_input and fanN_input */
+static int8_t match_input(const char *name, void *data) {
+  struct chip_scan *scan = data;
+  char file[NAME_MAX + 2], label[THERMAL_LABEL_LEN];
+  const char *p = name;
+  uint8_t fan;
+  int fd;
+
+  if (strncmp(name, "temp", 4) == 0) {
+    p += 4;
+    fan = 0;
+  } else if (strncmp(name, "fan", 3) == 0) {
+    p += 3;
+    fan = 1;
+  } else {
+    return 0;
+  }
+
+  if ((unsigned)(*p - '0') >= 10) {
+    return 0;
+  }
+  while ((unsigned)(*p - '0') < 10) {
+    p++;
+  }
+  if (strcmp(p, "_input") != 0) {
+    return 0;
+  }
+
+  /* Sensors without a label go by the name of their chip */
+  snprintf(file, sizeof(file), "/%.*s_label", (int)(p - name), name);
+  if (!sysfs_read(HWMON_DIR, scan->name, file, label, sizeof(label))) {
+    strncpy(label, scan->chip, sizeof(label));
+  }
+
+  if (!is_selected(scan->chip, label, fan)) {
+    return 0;
+  }
+
+  snprintf(file, sizeof(file), "/%s", name);
+  if ((fd = sysfs_open(HWMON_DIR, scan->name, file)) == -1) {
+    return 0;
+  }
+
+  sensors[sensor_count].fd = fd;
+  sensors[sensor_count].fan = fan;
+
+  return ++sensor_count == THERMAL_MAX_SENSORS;
+}
+
+static int8_t match_chip(const char *name, void *data) {
+  struct chip_scan scan;
+
+  (void)data;
+
+  scan.name = name;
+  if (!sysfs_read(HWMON_DIR, name, HWMON_NAME_FILE, scan.chip,
+                  sizeof(scan.chip))) {
+    return 0;
+  }
+
+  snprintf(scan.dir, sizeof(scan.dir), "%s%s", HWMON_DIR, name);
+  sysfs_scan_dir(scan.dir, match_input, &scan);
+
+  return sensor_count == THERMAL_MAX_SENSORS;
+}
+
+static void discover(void) {
+  sysfs_scan_dir(HWMON_DIR, match_chip, NULL);
+  discovered = 1;
+}
+
+int8_t thermal_sample(void) {
+  int64_t value;
+  uint8_t i;
+
+  if (!discovered) {
+    discover();
+  }
+
+  has_temp = has_fan = 0;
+  max_temp = max_fan = 0;
+
+  for (i = 0; i < sensor_count; i++) {
+    errno = 0;
+    if (!sysfs_pread_int(sensors[i].fd, &value)) {
+      /* The chip was unplugged; anything else is one bad reading */
+      if (errno == ENODEV || errno == ENOENT) {
+        thermal_invalidate();
+        return 0;
+      }
+      continue;
+    }
+
+    if (sensors[i].fan) {
+      has_fan = 1;
+      if (value > max_fan) {
+        max_fan = value;
+      }
+    } else {
+      value /= 1000; // millidegrees Celsius
+      if (!has_temp || value > max_temp) {
+        max_temp = value;
+      }
+      has_temp = 1;
+    }
+  }
+
+  return 1;
+}
+
+int8_t thermal_has_temp(void) { return has_temp; }
+
+int8_t thermal_has_fan(void) { return has_fan; }
+
+/* Hottest selected sensor in degrees Celsius */
+int32_t thermal_max_temp(void) { return max_temp; }
+
+/* Fastest selected fan in RPM */
+int32_t thermal_max_fan(void) { return max_fan; }
@@ -0,0 +1,22 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <stdint.h>
+
+#define HWMON_DIR "/sys/class/hwmon/"
+#define HWMON_NAME_FILE "/name"
+#define HWMON_SUBSYSTEM "hwmon"
+#define THERMAL_MAX_SENSORS 64
+#define THERMAL_MAX_SELECTORS 8
+#define THERMAL_SELECTION_LEN 256
+#define THERMAL_LABEL_LEN 32
+
+void thermal_select(const char *labels);
+void thermal_invalidate(void);
+int8_t thermal_sample(void);
+int8_t thermal_has_temp(void);
+int8_t thermal_has_fan(void);
+int32_t thermal_max_temp(void);
+int32_t thermal_max_fan(void);
+
+#endif // THERMAL_H
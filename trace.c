@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include "json.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Begin/end events of the collector phases, written as Chrome trace JSON
+ * for chrome://tracing or Perfetto. Events go into a ring that only the
+ * main thread touches, so recording one is a copy and no lock; the ring is
+ * written out once per frame or when it fills up. Without --trace every
+ * call returns right away.
+ *
+ * The file is a JSON array that is never closed: both viewers accept a
+ * trace that was cut off, which is how a bar usually ends.
+ */
+
+struct trace_event {
+  int64_t time; // CLOCK_MONOTONIC microseconds
+  char phase;   // 'B' or 'E'
+  char name[TRACE_NAME_LEN];
+};
+
+static int trace_fd = -1;
+static struct trace_event ring[TRACE_RING_LEN];
+static uint32_t head = 0, tail = 0; // free running, masked on use
+static long pid;
+static int8_t first = 1;
+
+static int64_t monotonic_microseconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int8_t trace_open(const char *path) {
+  if ((trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0644)) == -1) {
+    perror("open() failed!");
+    return 0;
+  }
+
+  pid = getpid();
+  return 1;
+}
+
+static void write_all(const char *buf, size_t len) {
+  ssize_t written;
+
+  while (len > 0) {
+    if ((written = write(trace_fd, buf, len)) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("write() failed!");
+      return;
+    }
+    buf += written;
+    len -= written;
+  }
+}
+
+/* One event as a JSON object, 0 when it does not fit */
+static size_t encode(const struct trace_event *event, char *buf) {
+  const char phase[] = {event->phase, '\0'};
+  struct json_writer writer;
+
+  json_init(&writer, buf, TRACE_EVENT_LEN);
+  json_begin_object(&writer);
+  json_key(&writer, "name");
+  json_string(&writer, event->name);
+  json_key(&writer, "ph");
+  json_string(&writer, phase);
+  json_key(&writer, "ts");
+  json_int(&writer, event->time);
+  json_key(&writer, "pid");
+  json_int(&writer, pid);
+  json_key(&writer, "tid");
+  json_int(&writer, pid);
+  json_end_object(&writer);
+
+  return writer.overflow ? 0 : writer.len;
+}
+
+/* Write out the events recorded since the last flush */
+void trace_flush(void) {
+  static char buffer[2 + TRACE_RING_LEN * (TRACE_EVENT_LEN + 2)];
+  size_t len = 0, event_len;
+
+  if (trace_fd == -1 || head == tail) {
+    return;
+  }
+
+  for (; tail != head; tail++) {
+    memcpy(buffer + len, first ? "[\n" : ",\n", 2);
+    if ((event_len = encode(&ring[tail & (TRACE_RING_LEN - 1)],
+                            buffer + len + 2)) > 0) {
+      len += 2 + event_len;
+      first = 0;
+    }
+  }
+
+  write_all(buffer, len);
+}
+
+static void record(char phase, const char *name) {
+  struct trace_event *event;
+
+  if (trace_fd == -1) {
+    return;
+  }
+
+  if (head - tail == TRACE_RING_LEN) {
+    trace_flush();
+  }
+
+  event = &ring[head & (TRACE_RING_LEN - 1)];
+  event->time = monotonic_microseconds();
+  event->phase = phase;
+  event->name[0] = '\0';
+  strncat(event->name, name, sizeof(event->name) - 1);
+  head++;
+}
+
+void trace_begin(const char *name) { record('B', name); }
+
+void trace_end(const char *name) { record('E', name); }
@@ -0,0 +1,15 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_LEN 1024 // events between two flushes, a power of two
+#define TRACE_NAME_LEN 48
+#define TRACE_EVENT_LEN 160 // one event as JSON
+
+int8_t trace_open(const char *path);
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_flush(void);
+
+#endif // TRACE_H
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+
+#include "uevent.h"
+
+#include <errno.h>
+#include <linux/netlink.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define UEVENT_KERNEL_GROUP 1
+#define UEVENT_ACTION_KEY "ACTION="
+#define UEVENT_SUBSYSTEM_KEY "SUBSYSTEM="
+
+/*
+ * Kernel hotplug events, the same stream `udevadm monitor --kernel` shows.
+ * Collectors that cache what they found in sysfs use it to learn when to
+ * look again instead of rescanning on every tick.
+ */
+int uevent_open(void) {
+  struct sockaddr_nl address;
+  int fd;
+
+  if ((fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                   NETLINK_KOBJECT_UEVENT)) == -1) {
+    perror("socket() failed!");
+    return -1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = UEVENT_KERNEL_GROUP;
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+    perror("bind() failed!");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* "add", "remove" and "move" change which devices there are */
+static int8_t is_hotplug(const char *action) {
+  return strcmp(action, "add") == 0 || strcmp(action, "remove") == 0 ||
+         strcmp(action, "move") == 0;
+}
+
+/*
+ * Drain the pending events and report which of `subsystems` had a device
+ * come or go, bit i standing for subsystems[i]; other actions on them, e.g.
+ * "change", are reported in `changed`. A message is "action@devpath"
+ * followed by NUL separated KEY=value pairs.
+ */
+uint32_t uevent_read(int fd, const char *const *subsystems, size_t count,
+                     uint32_t *changed) {
+  char buffer[UEVENT_BUFFER_LEN];
+  const char *action, *subsystem;
+  uint32_t hotplugged = 0;
+  ssize_t received;
+  size_t i;
+  char *p;
+
+  *changed = 0;
+
+  while ((received = recv(fd, buffer, sizeof(buffer) - 1, 0)) > 0) {
+    buffer[received] = '\0';
+    action = subsystem = NULL;
+
+    for (p = buffer; p < buffer + received; p += strlen(p) + 1) {
+      if (strncmp(p, UEVENT_ACTION_KEY, strlen(UEVENT_ACTION_KEY)) == 0) {
+        action = p + strlen(UEVENT_ACTION_KEY);
+      } else if (strncmp(p, UEVENT_SUBSYSTEM_KEY,
+                         strlen(UEVENT_SUBSYSTEM_KEY)) == 0) {
+        subsystem = p + strlen(UEVENT_SUBSYSTEM_KEY);
+      }
+    }
+
+    if (action == NULL || subsystem == NULL) {
+      continue;
+    }
+
+    for (i = 0; i < count; i++) {
+      if (strcmp(subsystem, subsystems[i]) != 0) {
+        continue;
+      }
+
+      if (is_hotplug(action)) {
+        hotplugged |= 1U << i;
+      } else {
+        *changed |= 1U << i;
+      }
+    }
+  }
+
+  if (received == -1 && errno != EAGAIN && errno != ENOBUFS) {
+    perror("recv() failed!");
+  }
+
+  return hotplugged;
+}
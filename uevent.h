@@ -0,0 +1,13 @@
+#ifndef UEVENT_H
+#define UEVENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UEVENT_BUFFER_LEN 4096
+
+int uevent_open(void);
+uint32_t uevent_read(int fd, const char *const *subsystems, size_t count,
+                     uint32_t *changed);
+
+#endif // UEVENT_H
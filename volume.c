@@ -1,153 +1,645 @@
+#include "clock.h"
+#include "replay.h"
+#include "trace.h"
 #include "volume.h"
 
+#include <ctype.h>
 #include <pulse/pulseaudio.h>
 #include <stdint.h>
 #include <string.h>
 
 #define APP_NAME "status"
+#define DEFAULT_SINK "@DEFAULT_SINK@"
+#define DEFAULT_SOURCE "@DEFAULT_SOURCE@"
+#define SINK_FIELD_LEN 128
+#define SINK_REPLAY_KEY "pulse sink"
+#define SOURCE_REPLAY_KEY "pulse source"
+#define CHANGED_REPLAY_KEY "pulse changed" // whether a refresh got answers
+#define PEAK_METER_APP "org.PulseAudio.pavucontrol" // records every source
+
+/* Events that change what the block shows; SERVER covers a new default */
+#define VOLUME_SUBSCRIPTION                                                    \
+  (PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE |                   \
+   PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT | PA_SUBSCRIPTION_MASK_SERVER)
+
+#define QUERY_COUNT 3 // sink, source and the streams reading from it
+
+static pa_mainloop *ml = NULL;
+static pa_context *ctx = NULL;
+static int8_t subscribed = 0; // on the current connection
+static pa_cvolume sink_volume;
 
 static uint8_t volume_result = 0;
 static uint8_t mute_result = 0;
 static uint8_t icon_type_result = IC_SPEAKER;
 static uint8_t results_cached = 0;
 
-static void context_state_cb(pa_context *context, void *mainloop) {
-  if (!context || !mainloop)
-    return;
+/* The default source, i.e. the microphone */
+struct source_fields {
+  uint8_t present;
+  uint8_t volume;
+  uint8_t mute;
+  uint8_t recording; // a stream is reading from it
+};
+
+static struct source_fields source_result;
+static struct source_fields source_answer; // filled in as replies come
+static uint32_t source_index = PA_INVALID_INDEX;
+
+/* The queries of a refresh, NULL once answered, until all of them are */
+static pa_operation *queries[QUERY_COUNT];
+static int answered[QUERY_COUNT];
 
-  pa_context_state_t state = pa_context_get_state(context);
-  switch (state) {
-  case PA_CONTEXT_READY:
-  case PA_CONTEXT_FAILED:
-  case PA_CONTEXT_TERMINATED:
-    *((int *)mainloop) = 1;
-    break;
-  default:
-    break;
+/* What the classification looks at, kept flat so a recording can hold it */
+struct sink_fields {
+  uint32_t index;
+  uint8_t volume;
+  uint8_t mute;
+  char name[SINK_FIELD_LEN];
+  char description[SINK_FIELD_LEN];
+  char form_factor[SINK_FIELD_LEN];
+  char device_description[SINK_FIELD_LEN];
+  char port_name[SINK_FIELD_LEN];
+  char port_description[SINK_FIELD_LEN];
+};
+
+static void copy_field(char *dest, const char *src) {
+  dest[0] = '\0';
+  if (src) {
+    strncat(dest, src, SINK_FIELD_LEN - 1);
   }
 }
 
-static void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol,
-                         void *userdata) {
-  (void)c; // Unused parameter
-  if (eol > 0 || !i) {
-    *((int *)userdata) = 1;
-    return;
+/* -----CLASSIFICATION----- */
+
+/*
+ * Words that make a sink headphones or a headset when its description,
+ * device description or active port mentions them, ignoring case. The
+ * built-in ones come first and users add theirs (e.g. "earbuds,AirPods") as
+ * headphones. Earlier words and fields win.
+ */
+struct sink_matcher {
+  const char *word;
+  uint8_t headset;
+};
+
+static const struct sink_matcher BuiltinMatchers[] = {
+    {"headphone", 0},
+    {"headset", 1},
+};
+
+static struct sink_matcher matchers[VOLUME_MAX_MATCHERS];
+static uint8_t matcher_count = 0;
+static char headphone_words[VOLUME_WORDS_LEN];
+
+/*
+ * What each (sink, active port) pair was classified as. Volume and mute
+ * changes come in as sink events by the dozen while a key is held down, and
+ * they only need a lookup here; a new port misses and is classified once.
+ */
+struct sink_class {
+  uint8_t used;
+  uint8_t icon;
+  uint32_t index;
+  char port[SINK_FIELD_LEN];
+};
+
+static struct sink_class sink_classes[VOLUME_SINK_CACHE_LEN];
+static uint8_t next_class = 0; // the entry a miss replaces
+
+static void forget_classes(uint32_t index) {
+  size_t i;
+
+  for (i = 0; i < VOLUME_SINK_CACHE_LEN; i++) {
+    if (index == PA_INVALID_INDEX || sink_classes[i].index == index) {
+      sink_classes[i].used = 0;
+    }
   }
+}
 
-  pa_volume_t vol = pa_cvolume_avg(&(i->volume));
-  volume_result = (short)((vol * 100ULL) / PA_VOLUME_NORM);
-  mute_result = i->mute ? 1 : 0;
+/*
+ * Take the comma separated `words` as extra headphone words, after the
+ * built-in ones. Sinks are classified again with the new table.
+ */
+void volume_select_headphones(const char *words) {
+  char *word;
+  size_t i;
+
+  matcher_count = 0;
+  for (i = 0; i < sizeof(BuiltinMatchers) / sizeof(BuiltinMatchers[0]); i++) {
+    matchers[matcher_count++] = BuiltinMatchers[i];
+  }
 
-  const char *form_factor =
-      pa_proplist_gets(i->proplist, PA_PROP_DEVICE_FORM_FACTOR);
-  const char *device_description =
-      pa_proplist_gets(i->proplist, PA_PROP_DEVICE_DESCRIPTION);
-  const char *description = i->description;
+  headphone_words[0] = '\0';
+  strncat(headphone_words, words, sizeof(headphone_words) - 1);
+  word = strtok(headphone_words, ",");
 
+  while (word && matcher_count < VOLUME_MAX_MATCHERS) {
+    matchers[matcher_count].word = word;
+    matchers[matcher_count++].headset = 0;
+    word = strtok(NULL, ",");
+  }
+
+  forget_classes(PA_INVALID_INDEX);
+}
+
+/* Whether `text` contains `word`, ignoring case */
+static int mentions(const char *text, const char *word) {
+  size_t i;
+
+  for (; *text != '\0'; text++) {
+    for (i = 0; word[i] != '\0' && tolower((unsigned char)text[i]) ==
+                                       tolower((unsigned char)word[i]);
+         i++)
+      ;
+    if (word[i] == '\0')
+      return 1;
+  }
+
+  return 0;
+}
+
+static uint8_t classify(const struct sink_fields *sink) {
+  const char *fields[] = {sink->description, sink->device_description,
+                          sink->port_name, sink->port_description};
   int is_headphone = 0;
   int is_headset = 0;
+  size_t i, j;
 
-  if (form_factor && strcmp(form_factor, "headset") == 0) {
-    is_headset = 1;
-  } else if (form_factor && strcmp(form_factor, "headphone") == 0) {
-    is_headphone = 1;
-  } else if (description && (strstr(description, "headphone") != NULL ||
-                             strstr(description, "Headphone") != NULL)) {
-    is_headphone = 1;
-  } else if (description && (strstr(description, "Headset") != NULL ||
-                             strstr(description, "headset") != NULL)) {
-    is_headset = 1;
-  } else if (device_description &&
-             (strstr(device_description, "headphone") != NULL ||
-              strstr(device_description, "Headphone") != NULL)) {
-    is_headphone = 1;
-  } else if (device_description &&
-             (strstr(device_description, "Headset") != NULL ||
-              strstr(device_description, "headset") != NULL)) {
+  if (matcher_count == 0) {
+    volume_select_headphones("");
+  }
+
+  if (strcmp(sink->form_factor, "headset") == 0) {
     is_headset = 1;
-  } else if (i->active_port && i->active_port->name &&
-             (strstr(i->active_port->name, "headphone") != NULL ||
-              strstr(i->active_port->name, "Headphone") != NULL)) {
-    is_headphone = 1;
-  } else if (i->active_port && i->active_port->description &&
-             (strstr(i->active_port->description, "Headphone") != NULL ||
-              strstr(i->active_port->description, "headphone") != NULL)) {
+  } else if (strcmp(sink->form_factor, "headphone") == 0) {
     is_headphone = 1;
   }
 
-  if (is_headset && i->name && strstr(i->name, "bluez") != NULL) {
-    icon_type_result = IC_BT_HEADSET;
+  for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    for (j = 0; j < matcher_count && !is_headset && !is_headphone; j++) {
+      if (mentions(fields[i], matchers[j].word)) {
+        is_headset = matchers[j].headset;
+        is_headphone = !matchers[j].headset;
+      }
+    }
+  }
+
+  if (is_headset && strstr(sink->name, "bluez") != NULL) {
+    return IC_BT_HEADSET;
   } else if (is_headset || is_headphone) {
-    icon_type_result = IC_HEADPHONE;
-  } else {
-    icon_type_result = IC_SPEAKER;
+    return IC_HEADPHONE;
   }
+  return IC_SPEAKER;
+}
 
-  *((int *)userdata) = 1;
+static void classify_sink(const struct sink_fields *sink) {
+  struct sink_class *entry;
+  size_t i;
+
+  volume_result = sink->volume;
+  mute_result = sink->mute;
+
+  for (i = 0; i < VOLUME_SINK_CACHE_LEN; i++) {
+    entry = &sink_classes[i];
+    if (entry->used && entry->index == sink->index &&
+        strcmp(entry->port, sink->port_name) == 0) {
+      icon_type_result = entry->icon;
+      return;
+    }
+  }
+
+  entry = &sink_classes[next_class];
+  next_class = (next_class + 1) % VOLUME_SINK_CACHE_LEN;
+
+  entry->used = 1;
+  entry->index = sink->index;
+  strcpy(entry->port, sink->port_name);
+  entry->icon = icon_type_result = classify(sink);
 }
 
-static void get_sink_info(void) {
-  pa_mainloop *ml = NULL;
-  pa_mainloop_api *api = NULL;
-  pa_context *ctx = NULL;
-  pa_operation *op = NULL;
-  int ready = 0;
+static void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol,
+                         void *userdata) {
+  struct sink_fields sink;
 
-  if (results_cached)
+  (void)c; // Unused parameter
+  if (eol > 0 || !i) {
+    *((int *)userdata) = 1;
     return;
+  }
 
-  ml = pa_mainloop_new();
-  if (!ml)
+  sink_volume = i->volume;
+
+  memset(&sink, 0, sizeof(sink));
+  sink.index = i->index;
+  sink.volume = (pa_cvolume_avg(&(i->volume)) * 100ULL) / PA_VOLUME_NORM;
+  sink.mute = i->mute ? 1 : 0;
+  copy_field(sink.name, i->name);
+  copy_field(sink.description, i->description);
+  copy_field(sink.form_factor,
+             pa_proplist_gets(i->proplist, PA_PROP_DEVICE_FORM_FACTOR));
+  copy_field(sink.device_description,
+             pa_proplist_gets(i->proplist, PA_PROP_DEVICE_DESCRIPTION));
+  if (i->active_port) {
+    copy_field(sink.port_name, i->active_port->name);
+    copy_field(sink.port_description, i->active_port->description);
+  }
+
+  /* What the refresh took is charged to CHANGED_REPLAY_KEY */
+  replay_capture(REPLAY_VALUE, SINK_REPLAY_KEY, &sink, sizeof(sink), 0,
+                 replay_calls());
+  classify_sink(&sink);
+
+  *((int *)userdata) = 1;
+}
+
+static void source_info_cb(pa_context *c, const pa_source_info *i, int eol,
+                           void *userdata) {
+  (void)c; // Unused parameter
+  if (eol > 0 || !i) {
+    *((int *)userdata) = 1;
     return;
+  }
 
-  api = pa_mainloop_get_api(ml);
-  ctx = pa_context_new(api, APP_NAME);
-  if (!ctx) {
-    pa_mainloop_free(ml);
+  source_index = i->index;
+  source_answer.present = 1;
+  source_answer.volume =
+      (pa_cvolume_avg(&(i->volume)) * 100ULL) / PA_VOLUME_NORM;
+  source_answer.mute = i->mute ? 1 : 0;
+
+  *((int *)userdata) = 1;
+}
+
+/*
+ * Replies come in the order the queries went out, so the default source is
+ * known by the time its streams are listed. Corked streams and peak meters
+ * are not recording anything.
+ */
+static void source_output_cb(pa_context *c, const pa_source_output_info *i,
+                             int eol, void *userdata) {
+  const char *application;
+
+  (void)c; // Unused parameter
+  if (eol || !i) {
+    *((int *)userdata) = 1;
     return;
   }
 
-  pa_context_set_state_callback(ctx, context_state_cb, &ready);
-  pa_context_connect(ctx, NULL, PA_CONTEXT_NOFLAGS, NULL);
+  application = pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_ID);
+
+  if (i->source == source_index && !i->corked &&
+      (application == NULL || strcmp(application, PEAK_METER_APP) != 0)) {
+    source_answer.recording = 1;
+  }
+}
+
+/*
+ * Any change to the devices or streams we show makes the next refresh ask.
+ * A sink that comes or goes drops its classifications, its index may be
+ * handed out again; port switches miss the cache on their own.
+ */
+static void subscribe_cb(pa_context *c, pa_subscription_event_type_t t,
+                         uint32_t idx, void *userdata) {
+  (void)c;        // Unused parameter
+  (void)userdata; // Unused parameter
+  results_cached = 0;
 
-  while (!ready)
-    pa_mainloop_iterate(ml, 1, NULL);
+  if ((t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) ==
+          PA_SUBSCRIPTION_EVENT_SINK &&
+      (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_CHANGE) {
+    forget_classes(idx);
+  }
+}
 
-  if (pa_context_get_state(ctx) != PA_CONTEXT_READY) {
-    goto cleanup;
+static void success_cb(pa_context *c, int success, void *userdata) {
+  (void)c;       // Unused parameter
+  (void)success; // Nothing to do on failure, the next query shows the truth
+  *((int *)userdata) = 1;
+}
+
+/*
+ * One mainloop iteration, a span of its own in a trace. It blocks no longer
+ * than the module's deadline, and once that has passed the caller gives up
+ * as it would on an error.
+ */
+static int iterate(void) {
+  int left = clock_deadline_left(), result;
+
+  trace_begin("pa_mainloop_iterate");
+  if ((result = pa_mainloop_prepare(ml, left < 0 ? -1 : left * 1000)) >= 0 &&
+      (result = pa_mainloop_poll(ml)) >= 0) {
+    result = pa_mainloop_dispatch(ml);
   }
+  trace_end("pa_mainloop_iterate");
 
-  ready = 0;
-  op = pa_context_get_sink_info_by_name(ctx, NULL, sink_info_cb, &ready);
+  if (result >= 0 && left >= 0 && clock_deadline_left() == 0) {
+    return -1;
+  }
+
+  return result;
+}
 
-  while (!ready)
-    pa_mainloop_iterate(ml, 1, NULL);
+static int all_done(pa_operation **ops, int *done, size_t count) {
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    if (ops[i] && !done[i])
+      return 0;
+
+  return 1;
+}
+
+/*
+ * Run the mainloop until the callback of every operation sets its `done`.
+ * Operations sent together share the round trip.
+ */
+static void wait_for_all(pa_operation **ops, int *done, size_t count) {
+  size_t i;
+
+  while (!all_done(ops, done, count))
+    if (iterate() < 0)
+      break;
+
+  for (i = 0; i < count; i++) {
+    if (!ops[i])
+      continue;
+
+    /* `done` lives on the caller's stack, a late reply must not reach it */
+    if (!done[i])
+      pa_operation_cancel(ops[i]);
+
+    pa_operation_unref(ops[i]);
+  }
+}
+
+static void wait_for(pa_operation *op, int *done) {
+  wait_for_all(&op, done, 1);
+}
+
+/* Drop the queries of a refresh that are still waiting for their replies */
+static void forget_queries(void) {
+  size_t i;
+
+  for (i = 0; i < QUERY_COUNT; i++) {
+    if (queries[i]) {
+      pa_operation_cancel(queries[i]);
+      pa_operation_unref(queries[i]);
+      queries[i] = NULL;
+    }
+  }
+}
+
+static void disconnect(void) {
+  forget_queries();
+  subscribed = 0;
 
-cleanup:
-  if (op)
-    pa_operation_unref(op);
   if (ctx) {
     pa_context_disconnect(ctx);
     pa_context_unref(ctx);
+    ctx = NULL;
   }
-  if (ml)
+  if (ml) {
     pa_mainloop_free(ml);
+    ml = NULL;
+  }
+}
+
+/*
+ * Connect once and keep the context around for every later query. A server
+ * that is slow to accept stays connecting across refreshes, each of them
+ * waiting for it until its deadline; only a failed connection starts over.
+ */
+static int connect_context(void) {
+  pa_mainloop_api *api = NULL;
+  pa_context_state_t state;
+  pa_operation *op;
 
-  results_cached = 1;
+  if (ctx && !PA_CONTEXT_IS_GOOD(pa_context_get_state(ctx)))
+    disconnect();
+
+  if (!ctx) {
+    ml = pa_mainloop_new();
+    if (!ml)
+      return 0;
+
+    api = pa_mainloop_get_api(ml);
+    ctx = pa_context_new(api, APP_NAME);
+    if (!ctx || pa_context_connect(ctx, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
+      disconnect();
+      return 0;
+    }
+  }
+
+  while ((state = pa_context_get_state(ctx)) != PA_CONTEXT_READY &&
+         PA_CONTEXT_IS_GOOD(state))
+    if (iterate() < 0)
+      break;
+
+  if ((state = pa_context_get_state(ctx)) != PA_CONTEXT_READY) {
+    if (!PA_CONTEXT_IS_GOOD(state))
+      disconnect();
+    return 0;
+  }
+
+  /*
+   * A new connection knows nothing yet; from here on events tell. There is
+   * no need to wait for the subscription: whatever changes before it is in
+   * place is in the answers to the first queries.
+   */
+  if (!subscribed) {
+    pa_context_set_subscribe_callback(ctx, subscribe_cb, NULL);
+    if ((op = pa_context_subscribe(ctx, VOLUME_SUBSCRIPTION, NULL, NULL)))
+      pa_operation_unref(op);
+    subscribed = 1;
+    results_cached = 0;
+  }
+
+  return 1;
 }
 
-uint8_t get_volume(void) {
-  get_sink_info();
-  return volume_result;
+/* Dispatch the events that came in since the last refresh, without waiting */
+static void drain_events(void) {
+  while (pa_mainloop_iterate(ml, 0, NULL) > 0)
+    ;
+}
+
+static int queries_pending(void) {
+  size_t i;
+
+  for (i = 0; i < QUERY_COUNT; i++)
+    if (queries[i])
+      return 1;
+
+  return 0;
 }
 
-uint8_t get_mute(void) {
-  get_sink_info();
-  return mute_result;
+/* Send the queries of a refresh; their callbacks fill in the answers */
+static void send_queries(void) {
+  memset(&source_answer, 0, sizeof(source_answer));
+  memset(answered, 0, sizeof(answered));
+  source_index = PA_INVALID_INDEX;
+
+  queries[0] =
+      pa_context_get_sink_info_by_name(ctx, NULL, sink_info_cb, &answered[0]);
+  queries[1] = pa_context_get_source_info_by_name(ctx, NULL, source_info_cb,
+                                                  &answered[1]);
+  queries[2] = pa_context_get_source_output_info_list(ctx, source_output_cb,
+                                                      &answered[2]);
 }
 
-uint8_t get_volume_icon_type(void) {
-  get_sink_info();
-  return icon_type_result;
+/*
+ * Wait for the answers until the deadline. Returns whether all of them came;
+ * otherwise the queries stay pending for the next refresh to wait on.
+ */
+static int wait_for_queries(void) {
+  size_t i;
+
+  while (!all_done(queries, answered, QUERY_COUNT))
+    if (iterate() < 0)
+      break;
+
+  if (!all_done(queries, answered, QUERY_COUNT))
+    return 0;
+
+  for (i = 0; i < QUERY_COUNT; i++) {
+    if (queries[i]) {
+      pa_operation_unref(queries[i]);
+      queries[i] = NULL;
+    }
+  }
+
+  source_result = source_answer;
+  return 1;
 }
+
+/* The answers of a recorded refresh, when it got any */
+static void replay_answers(void) {
+  const struct sink_fields *sink;
+  const struct source_fields *source;
+  size_t len;
+  int status;
+
+  if (replay_next(REPLAY_VALUE, CHANGED_REPLAY_KEY, &len, &status) != NULL &&
+      !status)
+    return;
+
+  trace_begin("get_sink_info");
+
+  sink = replay_next(REPLAY_VALUE, SINK_REPLAY_KEY, &len, &status);
+  if (sink && len == sizeof(*sink)) {
+    classify_sink(sink);
+  }
+  source = replay_next(REPLAY_VALUE, SOURCE_REPLAY_KEY, &len, &status);
+  if (source && len == sizeof(*source)) {
+    source_result = *source;
+  }
+
+  trace_end("get_sink_info");
+}
+
+/*
+ * The default sink, the default source and the streams reading from it, in
+ * one round trip. Nothing is asked while the subscription reports no change,
+ * so an idle refresh costs one non-blocking look at the connection. Queries
+ * left unanswered at the deadline are waited on by the next refresh instead
+ * of being asked again.
+ */
+void volume_refresh(void) {
+  uint32_t since = replay_calls();
+  int answered_all = 0;
+
+  if (replay_mode() == REPLAY_PLAYING) {
+    replay_answers();
+    return;
+  }
+
+  if (connect_context()) {
+    drain_events();
+
+    if (!results_cached || queries_pending()) {
+      trace_begin("get_sink_info");
+      if (!queries_pending()) {
+        /* Set first: an event in the same dispatch as a reply asks again */
+        results_cached = 1;
+        send_queries();
+      }
+      if ((answered_all = wait_for_queries()))
+        replay_capture(REPLAY_VALUE, SOURCE_REPLAY_KEY, &source_result,
+                       sizeof(source_result), 0, replay_calls());
+      trace_end("get_sink_info");
+    }
+  }
+
+  replay_capture(REPLAY_VALUE, CHANGED_REPLAY_KEY, NULL, 0, answered_all,
+                 since);
+}
+
+void volume_toggle_mute(void) {
+  int done = 0;
+
+  volume_refresh();
+
+  if (!connect_context())
+    return;
+
+  wait_for(pa_context_set_sink_mute_by_name(ctx, DEFAULT_SINK, !mute_result,
+                                            success_cb, &done),
+           &done);
+  results_cached = 0;
+}
+
+void volume_adjust(int8_t percent) {
+  pa_cvolume volume;
+  pa_volume_t step;
+  int done = 0;
+
+  volume_refresh();
+
+  if (!connect_context() || !sink_volume.channels)
+    return;
+
+  volume = sink_volume;
+  step = (PA_VOLUME_NORM * (percent < 0 ? -percent : percent)) / 100;
+
+  if (percent > 0) {
+    pa_cvolume_inc_clamp(&volume, step, PA_VOLUME_NORM);
+  } else {
+    pa_cvolume_dec(&volume, step);
+  }
+
+  wait_for(pa_context_set_sink_volume_by_name(ctx, DEFAULT_SINK, &volume,
+                                              success_cb, &done),
+           &done);
+  results_cached = 0;
+}
+
+void volume_toggle_mic_mute(void) {
+  int done = 0;
+
+  volume_refresh();
+
+  if (!connect_context() || !source_result.present)
+    return;
+
+  wait_for(pa_context_set_source_mute_by_name(ctx, DEFAULT_SOURCE,
+                                              !source_result.mute, success_cb,
+                                              &done),
+           &done);
+  results_cached = 0;
+}
+
+uint8_t get_volume(void) { return volume_result; }
+
+uint8_t get_mute(void) { return mute_result; }
+
+uint8_t get_volume_icon_type(void) { return icon_type_result; }
+
+/* -----MICROPHONE----- */
+
+uint8_t mic_present(void) { return source_result.present; }
+
+uint8_t get_mic_volume(void) { return source_result.volume; }
+
+uint8_t get_mic_mute(void) { return source_result.mute; }
+
+uint8_t mic_recording(void) { return source_result.recording; }
@@ -3,10 +3,31 @@
 
 #include <stdint.h>
 
-enum VolumeIcon { IC_SPEAKER, IC_HEADPHONE, IC_BT_HEADSET, IC_MUTE };
+#define VOLUME_MAX_MATCHERS 16
+#define VOLUME_WORDS_LEN 256
+#define VOLUME_SINK_CACHE_LEN 8
 
+enum VolumeIcon {
+  IC_SPEAKER,
+  IC_HEADPHONE,
+  IC_BT_HEADSET,
+  IC_MUTE,
+  IC_MIC,
+  IC_MIC_MUTE
+};
+
+void volume_select_headphones(const char *words);
+void volume_refresh(void);
 uint8_t get_volume(void);
 uint8_t get_mute(void);
 uint8_t get_volume_icon_type(void);
+void volume_toggle_mute(void);
+void volume_adjust(int8_t percent);
+
+uint8_t mic_present(void);
+uint8_t get_mic_volume(void);
+uint8_t get_mic_mute(void);
+uint8_t mic_recording(void);
+void volume_toggle_mic_mute(void);
 
 #endif // VOLUME_H
@@ -0,0 +1,446 @@
+#define _GNU_SOURCE
+
+#include "replay.h"
+#include "trace.h"
+#include "wifi.h"
+
+#include <errno.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/nl80211.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WIFI_ATTR_MAX NL80211_ATTR_SSID // the highest attribute looked at
+
+#define ATTR_DATA(attr) ((const char *)(attr) + NLA_HDRLEN)
+#define ATTR_LEN(attr) ((attr)->nla_len - NLA_HDRLEN)
+
+/*
+ * nl80211 spoken directly over generic netlink, as `iw` does. The family id
+ * and its "mlme" multicast group are looked up once and the socket stays
+ * open; a refresh is then a single send() carrying GET_INTERFACE (the SSID)
+ * and a GET_STATION dump (signal and bitrate of the access point). The
+ * kernel answers while send() and recv() run, so there is nothing to wait
+ * for besides the driver itself.
+ */
+
+static int sock = -1;
+static int8_t resolved = 0;
+static uint16_t family = 0; // 0 without cfg80211
+static uint32_t mlme_group = 0;
+static uint32_t seq = 0;
+
+static char buffer[WIFI_BUFFER_LEN];
+
+/* The device asked about last and its index */
+static char last_device[IF_NAMESIZE];
+static uint32_t last_ifindex = 0;
+
+/* What the replies to one request said */
+struct reply {
+  struct wifi_link link;
+  int8_t interface; // GET_INTERFACE was answered, so the device is wireless
+  int8_t station;   // a station (the access point) was listed
+};
+
+/* -----MESSAGES----- */
+
+/* Append a request to the `*len` bytes at `buf` */
+static struct nlmsghdr *add_message(char *buf, size_t *len, uint16_t type,
+                                    uint16_t flags, uint8_t cmd) {
+  struct nlmsghdr *header = (struct nlmsghdr *)(buf + *len);
+  struct genlmsghdr *genl = NLMSG_DATA(header);
+
+  memset(header, 0, NLMSG_HDRLEN + GENL_HDRLEN);
+  header->nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN;
+  header->nlmsg_type = type;
+  header->nlmsg_flags = NLM_F_REQUEST | flags;
+  header->nlmsg_seq = ++seq;
+  genl->cmd = cmd;
+  genl->version = 1;
+
+  *len += header->nlmsg_len;
+  return header;
+}
+
+/* Append an attribute to the request just added */
+static void add_attr(char *buf, size_t *len, struct nlmsghdr *header,
+                     uint16_t type, const void *data, uint16_t size) {
+  struct nlattr *attr = (struct nlattr *)(buf + *len);
+
+  memset(attr, 0, NLA_ALIGN(NLA_HDRLEN + size));
+  attr->nla_type = type;
+  attr->nla_len = NLA_HDRLEN + size;
+  memcpy((char *)attr + NLA_HDRLEN, data, size);
+
+  header->nlmsg_len += NLA_ALIGN(attr->nla_len);
+  *len += NLA_ALIGN(attr->nla_len);
+}
+
+static int8_t attr_fits(const char *p, const char *end) {
+  const struct nlattr *attr = (const struct nlattr *)p;
+
+  return end - p >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN &&
+         attr->nla_len <= end - p;
+}
+
+#define NEXT_ATTR(p) ((p) + NLA_ALIGN(((const struct nlattr *)(p))->nla_len))
+
+/* Index the attributes in [p, end) by type; ones above `max` are skipped */
+static void parse_attrs(const char *p, const char *end,
+                        const struct nlattr **table, uint16_t max) {
+  uint16_t type;
+
+  memset(table, 0, (max + 1) * sizeof(*table));
+
+  for (; attr_fits(p, end); p = NEXT_ATTR(p)) {
+    type = ((const struct nlattr *)p)->nla_type & NLA_TYPE_MASK;
+    if (type <= max) {
+      table[type] = (const struct nlattr *)p;
+    }
+  }
+}
+
+static void parse_nested(const struct nlattr *attr, const struct nlattr **table,
+                         uint16_t max) {
+  parse_attrs(ATTR_DATA(attr), (const char *)attr + attr->nla_len, table,
+              max);
+}
+
+static void parse_message(const struct nlmsghdr *header,
+                          const struct nlattr **table, uint16_t max) {
+  parse_attrs((const char *)NLMSG_DATA(header) + GENL_HDRLEN,
+              (const char *)header + header->nlmsg_len, table, max);
+}
+
+/*
+ * Send the requests in `req` and pass every reply to `handle` until the
+ * last request is answered. Errors end a request without a reply, which is
+ * how nl80211 turns down a device that is not wireless.
+ */
+static int8_t exchange(const char *req, size_t len,
+                       void (*handle)(const struct nlmsghdr *header,
+                                      void *data),
+                       void *data) {
+  struct nlmsghdr *header;
+  ssize_t count;
+  int left;
+
+  if (send(sock, req, len, 0) == -1) {
+    perror("send() failed!");
+    return 0;
+  }
+
+  while ((count = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+    left = (int)count;
+
+    for (header = (struct nlmsghdr *)buffer; NLMSG_OK(header, left);
+         header = NLMSG_NEXT(header, left)) {
+      if (header->nlmsg_type != NLMSG_DONE &&
+          header->nlmsg_type != NLMSG_ERROR) {
+        handle(header, data);
+      }
+
+      /* A dump ends with NLMSG_DONE, anything else with its only reply */
+      if (header->nlmsg_seq == seq &&
+          (header->nlmsg_type == NLMSG_DONE ||
+           header->nlmsg_type == NLMSG_ERROR ||
+           !(header->nlmsg_flags & NLM_F_MULTI))) {
+        return 1;
+      }
+    }
+  }
+
+  if (count == -1) {
+    perror("recv() failed!");
+  }
+
+  return 0;
+}
+
+/* -----FAMILY----- */
+
+static void handle_family(const struct nlmsghdr *header, void *data) {
+  const struct nlattr *attrs[CTRL_ATTR_MAX + 1];
+  const struct nlattr *group[CTRL_ATTR_MCAST_GRP_MAX + 1];
+  const struct nlattr *groups;
+  const char *p, *end;
+
+  (void)data; // Unused parameter
+
+  parse_message(header, attrs, CTRL_ATTR_MAX);
+
+  if (attrs[CTRL_ATTR_FAMILY_ID]) {
+    memcpy(&family, ATTR_DATA(attrs[CTRL_ATTR_FAMILY_ID]), sizeof(family));
+  }
+
+  if ((groups = attrs[CTRL_ATTR_MCAST_GROUPS]) == NULL) {
+    return;
+  }
+
+  end = (const char *)groups + groups->nla_len;
+  for (p = ATTR_DATA(groups); attr_fits(p, end); p = NEXT_ATTR(p)) {
+    parse_nested((const struct nlattr *)p, group, CTRL_ATTR_MCAST_GRP_MAX);
+
+    if (group[CTRL_ATTR_MCAST_GRP_NAME] && group[CTRL_ATTR_MCAST_GRP_ID] &&
+        strcmp(ATTR_DATA(group[CTRL_ATTR_MCAST_GRP_NAME]), WIFI_MLME_GROUP) ==
+            0) {
+      memcpy(&mlme_group, ATTR_DATA(group[CTRL_ATTR_MCAST_GRP_ID]),
+             sizeof(mlme_group));
+    }
+  }
+}
+
+/* Open the socket and look nl80211 up; machines without it give up once */
+static int8_t connect_nl80211(void) {
+  char req[WIFI_REQUEST_LEN];
+  struct nlmsghdr *header;
+  size_t len = 0;
+
+  if (resolved) {
+    return family != 0;
+  }
+  resolved = 1;
+
+  if ((sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) ==
+      -1) {
+    perror("socket() failed!");
+    return 0;
+  }
+
+  header = add_message(req, &len, GENL_ID_CTRL, 0, CTRL_CMD_GETFAMILY);
+  add_attr(req, &len, header, CTRL_ATTR_FAMILY_NAME, WIFI_FAMILY_NAME,
+           sizeof(WIFI_FAMILY_NAME));
+
+  if (!exchange(req, len, handle_family, NULL) || family == 0) {
+    close(sock);
+    sock = -1;
+    family = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* -----LINK----- */
+
+static void handle_reply(const struct nlmsghdr *header, void *data) {
+  const struct nlattr *attrs[WIFI_ATTR_MAX + 1];
+  const struct nlattr *info[NL80211_STA_INFO_MAX + 1];
+  const struct nlattr *rate[NL80211_RATE_INFO_MAX + 1];
+  const struct genlmsghdr *genl = NLMSG_DATA(header);
+  struct reply *reply = data;
+  uint16_t bitrate;
+  size_t len;
+
+  parse_message(header, attrs, WIFI_ATTR_MAX);
+
+  if (genl->cmd == NL80211_CMD_NEW_INTERFACE) {
+    reply->interface = 1;
+
+    if (attrs[NL80211_ATTR_SSID]) {
+      len = ATTR_LEN(attrs[NL80211_ATTR_SSID]);
+      len = len < WIFI_SSID_LEN - 1 ? len : WIFI_SSID_LEN - 1;
+      memcpy(reply->link.ssid, ATTR_DATA(attrs[NL80211_ATTR_SSID]), len);
+      reply->link.ssid[len] = '\0';
+    }
+    return;
+  }
+
+  /* A station interface lists one station, its access point */
+  if (genl->cmd != NL80211_CMD_NEW_STATION || reply->station ||
+      attrs[NL80211_ATTR_STA_INFO] == NULL) {
+    return;
+  }
+  reply->station = 1;
+
+  parse_nested(attrs[NL80211_ATTR_STA_INFO], info, NL80211_STA_INFO_MAX);
+
+  if (info[NL80211_STA_INFO_SIGNAL]) {
+    memcpy(&reply->link.signal, ATTR_DATA(info[NL80211_STA_INFO_SIGNAL]),
+           sizeof(reply->link.signal));
+  }
+
+  if (info[NL80211_STA_INFO_TX_BITRATE] == NULL) {
+    return;
+  }
+
+  parse_nested(info[NL80211_STA_INFO_TX_BITRATE], rate, NL80211_RATE_INFO_MAX);
+
+  if (rate[NL80211_RATE_INFO_BITRATE32]) {
+    memcpy(&reply->link.bitrate, ATTR_DATA(rate[NL80211_RATE_INFO_BITRATE32]),
+           sizeof(reply->link.bitrate));
+  } else if (rate[NL80211_RATE_INFO_BITRATE]) {
+    memcpy(&bitrate, ATTR_DATA(rate[NL80211_RATE_INFO_BITRATE]),
+           sizeof(bitrate));
+    reply->link.bitrate = bitrate;
+  }
+}
+
+/* Interface indexes only change when a device is recreated */
+static uint32_t device_index(const char *device) {
+  if (strcmp(device, last_device) != 0) {
+    strncpy(last_device, device, sizeof(last_device) - 1);
+    last_ifindex = if_nametoindex(device);
+  }
+
+  return last_ifindex;
+}
+
+static int8_t request(const char *device, int8_t station,
+                      struct reply *reply) {
+  char req[WIFI_REQUEST_LEN];
+  struct nlmsghdr *header;
+  uint32_t ifindex;
+  size_t len = 0;
+
+  memset(reply, 0, sizeof(*reply));
+
+  if (!connect_nl80211() || (ifindex = device_index(device)) == 0) {
+    return 0;
+  }
+
+  header = add_message(req, &len, family, 0, NL80211_CMD_GET_INTERFACE);
+  add_attr(req, &len, header, NL80211_ATTR_IFINDEX, &ifindex,
+           sizeof(ifindex));
+
+  if (station) {
+    header =
+        add_message(req, &len, family, NLM_F_DUMP, NL80211_CMD_GET_STATION);
+    add_attr(req, &len, header, NL80211_ATTR_IFINDEX, &ifindex,
+             sizeof(ifindex));
+  }
+
+  if (!exchange(req, len, handle_reply, reply)) {
+    return 0;
+  }
+
+  /* The device may be gone, or another one took its name */
+  if (!reply->interface) {
+    last_device[0] = '\0';
+  }
+
+  return 1;
+}
+
+/* Whether nl80211 knows the device, i.e. it is a Wi-Fi interface */
+int8_t wifi_is_wireless(const char *device) {
+  struct reply reply;
+
+  return request(device, 0, &reply) && reply.interface;
+}
+
+/*
+ * SSID, signal and bitrate of a wireless device, all zero while it is not
+ * associated. Returns 0 when nl80211 could not be asked.
+ */
+int8_t wifi_link(const char *device, struct wifi_link *link) {
+  char key[REPLAY_KEY_LEN];
+  const void *recorded;
+  struct reply reply;
+  uint32_t since = replay_calls();
+  int8_t answered;
+  size_t len;
+  int status;
+
+  snprintf(key, sizeof(key), "wifi %s", device);
+
+  if (replay_mode() == REPLAY_PLAYING) {
+    recorded = replay_next(REPLAY_VALUE, key, &len, &status);
+    if (recorded == NULL || len != sizeof(*link)) {
+      return 0;
+    }
+    memcpy(link, recorded, sizeof(*link));
+    return status;
+  }
+
+  trace_begin("nl80211");
+  answered = request(device, 1, &reply) && reply.interface;
+  trace_end("nl80211");
+
+  *link = reply.link;
+  replay_capture(REPLAY_VALUE, key, link, sizeof(*link), answered, since);
+
+  return answered;
+}
+
+/* -----EVENTS----- */
+
+/*
+ * A socket of its own in the "mlme" group, which carries connects,
+ * disconnects and roams as they happen. -1 without nl80211.
+ */
+int wifi_events_open(void) {
+  int fd;
+
+  if (!connect_nl80211() || mlme_group == 0) {
+    return -1;
+  }
+
+  if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                   NETLINK_GENERIC)) == -1) {
+    perror("socket() failed!");
+    return -1;
+  }
+
+  if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &mlme_group,
+                 sizeof(mlme_group)) == -1) {
+    perror("setsockopt() failed!");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int8_t is_association(uint8_t cmd) {
+  switch (cmd) {
+  case NL80211_CMD_CONNECT:
+  case NL80211_CMD_DISCONNECT:
+  case NL80211_CMD_ROAM:
+  case NL80211_CMD_ASSOCIATE:
+  case NL80211_CMD_DISASSOCIATE:
+  case NL80211_CMD_DEAUTHENTICATE:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Drain the pending events and report whether an association changed. An
+ * overrun socket lost some, so that counts as a change as well.
+ */
+int8_t wifi_events_read(int fd) {
+  const struct genlmsghdr *genl;
+  struct nlmsghdr *header;
+  int8_t changed = 0;
+  ssize_t count;
+  int left;
+
+  while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    left = (int)count;
+
+    for (header = (struct nlmsghdr *)buffer; NLMSG_OK(header, left);
+         header = NLMSG_NEXT(header, left)) {
+      genl = NLMSG_DATA(header);
+      if (header->nlmsg_type == family && is_association(genl->cmd)) {
+        changed = 1;
+      }
+    }
+  }
+
+  if (count == -1 && errno == ENOBUFS) {
+    return 1;
+  }
+  if (count == -1 && errno != EAGAIN) {
+    perror("recv() failed!");
+  }
+
+  return changed;
+}
@@ -0,0 +1,24 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include <stdint.h>
+
+#define WIFI_FAMILY_NAME "nl80211"
+#define WIFI_MLME_GROUP "mlme"
+#define WIFI_SSID_LEN 33 // 32 bytes and a NUL
+#define WIFI_REQUEST_LEN 256
+#define WIFI_BUFFER_LEN (16 * 1024)
+
+/* The association of a station interface; ssid is empty without one */
+struct wifi_link {
+  char ssid[WIFI_SSID_LEN];
+  int8_t signal;    // dBm
+  uint32_t bitrate; // transmit rate in 100 kbit/s
+};
+
+int8_t wifi_is_wireless(const char *device);
+int8_t wifi_link(const char *device, struct wifi_link *link);
+int wifi_events_open(void);
+int8_t wifi_events_read(int fd);
+
+#endif // WIFI_H
@@ -0,0 +1,118 @@
+#include "x11.h"
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+
+#define ROOT_NAME_LEN 4096
+
+/*
+ * libxcb is loaded at runtime so the binary keeps working on machines without
+ * X; only the handful of entry points needed to set WM_NAME are resolved.
+ */
+
+typedef xcb_connection_t *(*xcb_connect_fn)(const char *, int *);
+typedef int (*xcb_connection_has_error_fn)(xcb_connection_t *);
+typedef const xcb_setup_t *(*xcb_get_setup_fn)(xcb_connection_t *);
+typedef xcb_screen_iterator_t (*xcb_setup_roots_iterator_fn)(
+    const xcb_setup_t *);
+typedef void (*xcb_screen_next_fn)(xcb_screen_iterator_t *);
+typedef xcb_void_cookie_t (*xcb_change_property_fn)(xcb_connection_t *,
+                                                    uint8_t, xcb_window_t,
+                                                    xcb_atom_t, xcb_atom_t,
+                                                    uint8_t, uint32_t,
+                                                    const void *);
+typedef int (*xcb_flush_fn)(xcb_connection_t *);
+typedef void (*xcb_disconnect_fn)(xcb_connection_t *);
+
+static xcb_change_property_fn change_property;
+static xcb_flush_fn flush;
+static xcb_connection_has_error_fn connection_has_error;
+
+static xcb_connection_t *connection = NULL;
+static xcb_window_t root;
+
+static char root_name[ROOT_NAME_LEN];
+static size_t root_name_len = 0;
+static int8_t root_name_set = 0;
+
+int8_t x11_root_open(void) {
+  void *xcb;
+  xcb_connect_fn connect;
+  xcb_disconnect_fn disconnect;
+  xcb_get_setup_fn get_setup;
+  xcb_setup_roots_iterator_fn roots_iterator;
+  xcb_screen_next_fn screen_next;
+  xcb_screen_iterator_t screens;
+  int screen = 0;
+
+  if ((xcb = dlopen(XCB_LIBRARY, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+    fprintf(stderr, "dlopen() failed: %s\n", dlerror());
+    return 0;
+  }
+
+  connect = (xcb_connect_fn)dlsym(xcb, "xcb_connect");
+  connection_has_error =
+      (xcb_connection_has_error_fn)dlsym(xcb, "xcb_connection_has_error");
+  get_setup = (xcb_get_setup_fn)dlsym(xcb, "xcb_get_setup");
+  roots_iterator =
+      (xcb_setup_roots_iterator_fn)dlsym(xcb, "xcb_setup_roots_iterator");
+  screen_next = (xcb_screen_next_fn)dlsym(xcb, "xcb_screen_next");
+  change_property = (xcb_change_property_fn)dlsym(xcb, "xcb_change_property");
+  flush = (xcb_flush_fn)dlsym(xcb, "xcb_flush");
+  disconnect = (xcb_disconnect_fn)dlsym(xcb, "xcb_disconnect");
+
+  if (!connect || !connection_has_error || !get_setup || !roots_iterator ||
+      !screen_next || !change_property || !flush || !disconnect) {
+    fprintf(stderr, "dlsym() failed: %s\n", XCB_LIBRARY);
+    dlclose(xcb);
+    return 0;
+  }
+
+  connection = connect(NULL, &screen);
+
+  /* A failed connection is still allocated and has to be disconnected */
+  if (connection_has_error(connection)) {
+    fprintf(stderr, "cannot open display!\n");
+    disconnect(connection);
+    connection = NULL;
+    dlclose(xcb);
+    return 0;
+  }
+
+  screens = roots_iterator(get_setup(connection));
+  while (screen-- > 0 && screens.rem > 1) {
+    screen_next(&screens);
+  }
+  root = screens.data->root;
+
+  return 1;
+}
+
+/* Same encoding as `xsetroot -name`: raw bytes in a STRING typed WM_NAME */
+void x11_root_set_name(const char *name, size_t len) {
+  if (len > sizeof(root_name)) {
+    len = sizeof(root_name);
+  }
+
+  if (root_name_set && len == root_name_len &&
+      memcmp(name, root_name, len) == 0) {
+    return;
+  }
+
+  change_property(connection, XCB_PROP_MODE_REPLACE, root, XCB_ATOM_WM_NAME,
+                  XCB_ATOM_STRING, 8, len, name);
+  flush(connection);
+
+  memcpy(root_name, name, len);
+  root_name_len = len;
+  root_name_set = 1;
+
+  if (connection_has_error(connection)) {
+    fprintf(stderr, "lost connection to the display!\n");
+    exit(1);
+  }
+}
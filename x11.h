@@ -0,0 +1,12 @@
+#ifndef X11_H
+#define X11_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define XCB_LIBRARY "libxcb.so.1"
+
+int8_t x11_root_open(void);
+void x11_root_set_name(const char *name, size_t len);
+
+#endif // X11_H